@@ -1,4 +1,4 @@
-#include <binary_graph_stream.h>
+#include <mmap_graph_stream.h>
 #include <graph_distrib_update.h>
 #include <math.h>
 #include <work_distributor.h>
@@ -57,7 +57,7 @@ int main(int argc, char** argv) {
     std::string input = argv[5];
     std::string output = argv[6];
 
-    BinaryGraphStream_MT stream(input, 32 * 1024);
+    MmapGraphStream stream(input);
 
     node_id_t num_nodes = stream.nodes();
     long m = stream.edges();
@@ -71,13 +71,11 @@ int main(int argc, char** argv) {
     threads.reserve(inserter_threads);
 
     auto task = [&](const int thr_id) {
-      MT_StreamReader reader(stream);
-      GraphUpdate upd;
-      while (true) {
-        upd = reader.get_edge();
-        if (upd.type == BREAKPOINT) break;
-        g.update(upd, thr_id);
-      }
+      MmapStreamReader reader(stream);
+      std::vector<GraphUpdate> upds(GraphDistribUpdate::update_batch_chunk);
+      size_t num_upds;
+      while ((num_upds = reader.get_edges(upds.data(), upds.size())) > 0)
+        g.update_batch(upds.data(), num_upds, thr_id);
     };
 
     auto start = std::chrono::steady_clock::now();
@@ -142,20 +140,22 @@ int main(int argc, char** argv) {
 
     auto task = [&](const int thr_id) {
       GraphStreamUpdate upds[256];
+      GraphUpdate g_upds[256];
       bool running = true;
       while (running) {
         size_t num_upds = stream.get_update_buffer(upds, 256);
+        size_t num_g_upds = 0;
         for (size_t i = 0; i < num_upds; i++) {
           GraphStreamUpdate upd = upds[i];
           if (upd.type == BREAKPOINT) {
             running = false;
             break;
           }
-          GraphUpdate g_upd;
-          g_upd.edge = upd.edge;
-          g_upd.type = static_cast<UpdateType>(upd.type);
-          g.update(g_upd, thr_id);
+          g_upds[num_g_upds].edge = upd.edge;
+          g_upds[num_g_upds].type = static_cast<UpdateType>(upd.type);
+          num_g_upds++;
         }
+        g.update_batch(g_upds, num_g_upds, thr_id);
       }
     };
 
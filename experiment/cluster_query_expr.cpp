@@ -1,7 +1,10 @@
 #include <graph_distrib_update.h>
-#include <binary_graph_stream.h>
+#include <mmap_graph_stream.h>
 #include <work_distributor.h>
 
+#include <algorithm>
+#include <cmath>
+#include <iomanip>
 #include <string>
 #include <iostream>
 #include <unordered_map>
@@ -19,6 +22,8 @@ int main(int argc, char **argv) {
     int num_grouped = 1;
     int ins_btwn_qrys = 0;
     bool point_queries = false;
+    std::string phase_file;
+    DistribConfiguration conf;
     std::vector<std::function<bool(char*)>> parse;
     std::unordered_map<std::string, std::function<void(void)>> long_options;
 
@@ -93,6 +98,24 @@ int main(int argc, char **argv) {
       point_queries = true;
     };
 
+    const auto arg_backup_dir = [&](char* arg) -> bool {
+      conf.backup_in_mem(false).backup_dir(arg);
+      return true;
+    };
+
+    const auto opt_backup_dir = [&]() {
+      parse.push_back(arg_backup_dir);
+    };
+
+    const auto arg_phase_file = [&](char* arg) -> bool {
+      phase_file = arg;
+      return true;
+    };
+
+    const auto opt_phases = [&]() {
+      parse.push_back(arg_phase_file);
+    };
+
     parse.push_back(arg_output);
     parse.push_back(arg_input);
     parse.push_back(arg_num_queries);
@@ -101,10 +124,13 @@ int main(int argc, char **argv) {
     long_options["point"] = opt_point;
     long_options["repeat"] = opt_repeats;
     long_options["burst"] = opt_burst;
+    long_options["backup_dir"] = opt_backup_dir;
+    long_options["phases"] = opt_phases;
 
     const auto print_usage = [&]() {
       std::cout << "Arguments are: insert_threads, num_queries, input_stream, output_file, ";
-      std::cout << "[--point], [--repeat <num_repeats>], [--burst <num_grouped> <ins_btwn_qry>]" << std::endl;
+      std::cout << "[--point], [--repeat <num_repeats>], [--burst <num_grouped> <ins_btwn_qry>], ";
+      std::cout << "[--backup_dir <dir>], [--phases <phase_file>]" << std::endl;
       std::cout << "insert_threads:  number of threads inserting to guttering system" << std::endl;
       std::cout << "num_queries:     number of queries to issue during the stream." << std::endl;
       std::cout << "input_stream:    the binary stream to ingest." << std::endl;
@@ -115,6 +141,11 @@ int main(int argc, char **argv) {
       std::cout << "--burst <num_grouped> <ins_btwn_qry>: [OPTIONAL] if present then queries should be bursty" << std::endl;
       std::cout << "  num_grouped:   specifies how many queries should be grouped together" << std::endl;
       std::cout << "  ins_btwn_qry:  specifies the number of insertions to perform between each query" << std::endl;
+      std::cout << "--backup_dir <dir>: [OPTIONAL] if present then back up modified sketches to dir" << std::endl;
+      std::cout << "  during queries instead of copying every sketch in memory" << std::endl;
+      std::cout << "--phases <phase_file>: [OPTIONAL] if present then write the latency of each phase" << std::endl;
+      std::cout << "  of every query to phase_file and print their percentiles. Each of the" << std::endl;
+      std::cout << "  100 point queries of --point counts as a query" << std::endl;
     };
 
     for (int i = 1; i < argc; ++i) {
@@ -152,7 +183,7 @@ int main(int argc, char **argv) {
       return EXIT_FAILURE;
     }
 
-    BinaryGraphStream_MT stream(input, 32 * 1024);
+    MmapGraphStream stream(input);
 
     node_id_t num_nodes   = stream.nodes();
     edge_id_t num_updates = stream.edges();
@@ -163,7 +194,7 @@ int main(int argc, char **argv) {
     std::cout << "Vertices = " << num_nodes << std::endl;
     std::cout << "Edges    = " << num_updates << std::endl;
 
-    GraphDistribUpdate g{num_nodes, inserter_threads};
+    GraphDistribUpdate g{num_nodes, inserter_threads, 1, conf};
 
     std::vector<std::thread> threads;
     threads.reserve(inserter_threads);
@@ -212,17 +243,28 @@ int main(int argc, char **argv) {
     std::atomic<bool> next_stream_repeat;
     next_stream_repeat = false;
 
+    // the phases of every query, only written by the thread performing queries
+    std::vector<QueryPhases> query_phases;
+
     auto seed = std::random_device()();
     // task for threads that insert to the graph and perform queries
     auto task = [&](const int thr_id) {
       std::default_random_engine rand_engine(seed + thr_id);
       std::uniform_int_distribution<node_id_t> rand_node(0, num_nodes - 1);
-      MT_StreamReader reader(stream);
-      GraphUpdate upd;
+      MmapStreamReader reader(stream);
+      std::vector<GraphUpdate> upds(GraphDistribUpdate::update_batch_chunk);
       while(true) {
-        upd = reader.get_edge();
-        if (upd.type == BREAKPOINT && num_queries == 0) return;
-        else if (upd.type == BREAKPOINT) { // do a query
+        // get_edges() stops short of a BREAKPOINT, so a query sees every update before it
+        size_t num_upds = reader.get_edges(upds.data(), upds.size());
+        if (num_upds > 0) {
+          for (size_t i = 0; i < num_upds; i++) {
+            if (upds[i].type != INSERT && upds[i].type != DELETE)
+              throw std::invalid_argument("Did not recognize edge code!");
+          }
+          g.update_batch(upds.data(), num_upds, thr_id);
+        }
+        else if (num_queries == 0) return;
+        else { // do a query
           auto cc_start = std::chrono::steady_clock::now();
           if (next_stream_repeat)
             return; // this breakpoint is a stream repeat
@@ -253,7 +295,9 @@ int main(int argc, char **argv) {
             if (point_queries) {
               node_id_t a = rand_node(rand_engine);
               node_id_t b = rand_node(rand_engine);
-              bool connected = g.point_to_point_query(a, b);
+              QueryPhases phases;
+              bool connected = g.point_to_point_query(a, b, QueryStaleness(), &phases);
+              query_phases.push_back(phases);
               std::cout << "QUERY DONE at index " << query_idx << ", " << a << " and " << b 
                 << " connected: " << (connected? "true" : "false") << std::endl;
               std::chrono::duration<double>flush(g.flush_end - g.flush_start);
@@ -264,7 +308,8 @@ int main(int argc, char **argv) {
               for(int i = 0; i < 99; i++) {
                       a = rand_node(rand_engine);
                       b = rand_node(rand_engine);
-                      connected = g.point_to_point_query(a, b);
+                      connected = g.point_to_point_query(a, b, QueryStaleness(), &phases);
+                query_phases.push_back(phases);
                 x += connected;
               }
 
@@ -280,7 +325,9 @@ int main(int argc, char **argv) {
               cc_status_out << queries_done / num_grouped << ", " << flush.count() << ", " << alg_latency.count() << ", P2P" << std::endl;
 
             } else {
-              size_t num_CC = g.get_connected_components(true).size();
+              QueryPhases phases;
+              size_t num_CC = g.get_connected_components(true, QueryStaleness(), &phases).size();
+              query_phases.push_back(phases);
               std::cout << "QUERY DONE at index " << query_idx << " Found " << num_CC << " connected components" << std::endl;
 
               std::chrono::duration<double> q_latency = g.cc_alg_end - cc_start;
@@ -324,10 +371,6 @@ int main(int argc, char **argv) {
             q_done_cond.notify_all();
           }
         }
-        else if (upd.type == INSERT || upd.type == DELETE)
-          g.update(upd, thr_id);
-        else
-          throw std::invalid_argument("Did not recognize edge code!");
       }
     };
 
@@ -383,6 +426,44 @@ int main(int argc, char **argv) {
     std::cout << "CC alg latency      = " << std::chrono::duration<double>(g.cc_alg_end - g.cc_alg_start).count() << std::endl;
 
     cc_status_out.close();
+
+    if (!phase_file.empty() && !query_phases.empty()) {
+      std::ofstream phase_out{phase_file, std::ios_base::out | std::ios_base::trunc};
+      phase_out << "query";
+      for (int p = 0; p < QueryPhases::num_phases; p++) phase_out << "," << QueryPhases::name(p);
+      phase_out << ",total,cached" << std::endl;
+      for (size_t i = 0; i < query_phases.size(); i++) {
+        phase_out << i;
+        for (int p = 0; p < QueryPhases::num_phases; p++) phase_out << "," << query_phases[i].get(p);
+        phase_out << "," << query_phases[i].total() << "," << query_phases[i].cached << std::endl;
+      }
+
+      // nearest rank percentiles of each phase, the last column is the whole query
+      const auto percentile = [](const std::vector<double> &sorted, double q) {
+        size_t rank = std::ceil(q * sorted.size());
+        return sorted[rank == 0 ? 0 : rank - 1];
+      };
+      std::cout << "Latency of " << query_phases.size() << " queries in milliseconds" << std::endl;
+      std::cout << std::left << std::setw(8) << "phase" << std::right;
+      for (const char *col : {"mean", "p50", "p90", "p99", "max"}) std::cout << std::setw(12) << col;
+      std::cout << std::endl << std::fixed << std::setprecision(3);
+      for (int p = 0; p <= QueryPhases::num_phases; p++) {
+        std::vector<double> values;
+        for (auto &phases : query_phases)
+          values.push_back(p < QueryPhases::num_phases ? phases.get(p) : phases.total());
+        std::sort(values.begin(), values.end());
+        double mean = 0;
+        for (double v : values) mean += v / values.size();
+        std::cout << std::left << std::setw(8)
+                  << (p < QueryPhases::num_phases ? QueryPhases::name(p) : "total") << std::right;
+        for (double v : {mean, percentile(values, 0.5), percentile(values, 0.9),
+                         percentile(values, 0.99), values.back()})
+          std::cout << std::setw(12) << v * 1e3;
+        std::cout << std::endl;
+      }
+      std::cout << std::defaultfloat;
+      std::cout << "Wrote the phases of every query to " << phase_file << std::endl;
+    }
   }
 
   GraphDistribUpdate::teardown_cluster();
@@ -1,4 +1,4 @@
-#include <binary_graph_stream.h>
+#include <mmap_graph_stream.h>
 #include <graph_distrib_update.h>
 #include <math.h>
 #include <work_distributor.h>
@@ -12,13 +12,13 @@
 int main(int argc, char** argv) {
   GraphDistribUpdate::setup_cluster(argc, argv);
 
-  if (argc != 6) {
+  if (argc != 6 && argc != 7) {
     std::cerr << "Incorrect number of arguments. "
-                 "Expected five but got "
+                 "Expected five or six but got "
               << argc - 1 << std::endl;
     std::cerr << "Arguments are: insert_threads, format" << std::endl;
     std::cerr << "Format='file' args are:  repeats, input_stream, output_file" << std::endl;
-    std::cerr << "Format='erdos' args are: vertices, edges, output_file" << std::endl;
+    std::cerr << "Format='erdos' args are: vertices, edges, output_file, [seed]" << std::endl;
     exit(EXIT_FAILURE);
   }
   int inserter_threads = std::atoi(argv[1]);
@@ -43,7 +43,7 @@ int main(int argc, char** argv) {
     std::string input = argv[4];
     std::string output = argv[5];
 
-    BinaryGraphStream_MT stream(input, 32 * 1024);
+    MmapGraphStream stream(input);
 
     node_id_t num_nodes = stream.nodes();
     long m = stream.edges();
@@ -57,13 +57,11 @@ int main(int argc, char** argv) {
     threads.reserve(inserter_threads);
 
     auto task = [&](const int thr_id) {
-      MT_StreamReader reader(stream);
-      GraphUpdate upd;
-      while (true) {
-        upd = reader.get_edge();
-        if (upd.type == BREAKPOINT) break;
-        g.update(upd, thr_id);
-      }
+      MmapStreamReader reader(stream);
+      std::vector<GraphUpdate> upds(GraphDistribUpdate::update_batch_chunk);
+      size_t num_upds;
+      while ((num_upds = reader.get_edges(upds.data(), upds.size())) > 0)
+        g.update_batch(upds.data(), num_upds, thr_id);
     };
 
     auto start = std::chrono::steady_clock::now();
@@ -112,8 +110,10 @@ int main(int argc, char** argv) {
     std::cout << "Edges    = " << num_edges << std::endl;
 
     std::string output = argv[5];
+    // a fixed seed makes the stream identical across runs
+    size_t stream_seed = argc == 7 ? std::stoull(argv[6]) : time(nullptr);
 
-    SimpleStream stream(time(nullptr), num_vertices);
+    SimpleStream stream(stream_seed, num_vertices);
     stream.set_break_point(num_edges);
     GraphDistribUpdate g{num_vertices, inserter_threads};
 
@@ -122,20 +122,22 @@ int main(int argc, char** argv) {
 
     auto task = [&](const int thr_id) {
       GraphStreamUpdate upds[256];
+      GraphUpdate g_upds[256];
       bool running = true;
       while (running) {
         size_t num_upds = stream.get_update_buffer(upds, 256);
+        size_t num_g_upds = 0;
         for (size_t i = 0; i < num_upds; i++) {
           GraphStreamUpdate upd = upds[i];
           if (upd.type == BREAKPOINT) {
             running = false;
             break;
           }
-          GraphUpdate g_upd;
-          g_upd.edge = upd.edge;
-          g_upd.type = static_cast<UpdateType>(upd.type);
-          g.update(g_upd, thr_id);
+          g_upds[num_g_upds].edge = upd.edge;
+          g_upds[num_g_upds].type = static_cast<UpdateType>(upd.type);
+          num_g_upds++;
         }
+        g.update_batch(g_upds, num_g_upds, thr_id);
       }
     };
 
@@ -163,6 +165,8 @@ int main(int argc, char** argv) {
 
     std::cout << "Processing " << num_edges << " updates took " << runtime.count() << " seconds, "
               << ins_per_sec << " per second\n";
+    std::chrono::duration<double> flush_time = g.flush_end - g.flush_start;
+    std::cout << "Final flush took " << flush_time.count() << " seconds\n";
 
     std::cout << "Connected Components algorithm took " << CC_time.count() << " and found "
               << num_CC << " CC\n";
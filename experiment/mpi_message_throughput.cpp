@@ -2,29 +2,235 @@
 #include <iostream>
 #include <chrono>
 #include <thread>
+#include <mutex>
+#include <vector>
+#include <string>
+#include <sstream>
+#include <stdexcept>
+#include <algorithm>
+#include <cstring>
+#include <cstdint>
 
 constexpr size_t MB = 1024 * 1024;
 
 /*
- * This code is designed to test the speed of MPI in a variety of contexts
- * Ideas for parameters:
- * 1. Number of threads sending (num recv determined by -np)
- * 2. Thread support level
- * 3. Probe before Recv or not
- * 4. Ssend vs Send vs Issend vs Isend
- * 5. Message size
- * 6. Number of messages
- * 7. Random vs identical messages
- * 8. Prepopulate messages or generate on the fly
- * 9. Recievers send ACK or messages of their own
+ * This code is designed to test the speed of MPI in a variety of contexts.
+ * Rank 0 sends messages from one or more threads, every other rank recieves
+ * them. Sender thread t sends to rank 1 + t % (np - 1) using tag t.
+ *
+ * Every option except --thread_level takes a comma separated list, and every
+ * combination of the lists is run. The parameters are:
+ *  --thread_level  single, funneled, serialized or multiple (default multiple)
+ *  --threads       number of sending threads (default 1)
+ *  --probe         0 to Recv into a buffer of the largest size, 1 to Probe the
+ *                  size before each Recv as Landscape does (default 1)
+ *  --send          send, ssend, isend or issend (default send)
+ *  --sizes         message sizes in bytes, K and M suffixes allowed (default 100)
+ *                  Landscape prints the BATCH and DELTA sizes of a graph when its cluster starts
+ *  --messages      messages per sending thread, 0 to send --bytes per thread (default 0)
+ *  --bytes         bytes per sending thread when --messages is 0 (default 256M)
+ *  --content       random or identical messages (default identical)
+ *  --prepopulate   1 to generate messages before timing, 0 to generate each one
+ *                  before it is sent (default 1)
+ *  --reply         none, ack (4 bytes) or echo (the message size) (default ack)
+ *  --window        outstanding isend/issend requests per thread (default 8)
+ *  --format        csv or json, one line per combination (default csv)
+ *
+ * Combinations the thread level does not allow are skipped. Example:
+ *   mpirun -np 3 ./mpi_experiment --threads=1,4 --send=send,isend --sizes=4K,1M --reply=none,ack
  */
 
+struct Config {
+  int threads;
+  bool probe;
+  std::string send;
+  size_t size;
+  size_t messages;
+  std::string content;
+  bool prepopulate;
+  std::string reply;
+};
+
+static constexpr size_t ack_bytes = 4;
+
+static std::vector<std::string> split(const std::string &list) {
+  std::vector<std::string> items;
+  std::stringstream stream(list);
+  std::string item;
+  while (std::getline(stream, item, ',')) {
+    if (!item.empty()) items.push_back(item);
+  }
+  if (items.empty()) throw std::invalid_argument("empty list: " + list);
+  return items;
+}
+
+static size_t parse_size(const std::string &str) {
+  size_t pos;
+  size_t value = std::stoull(str, &pos);
+  std::string suffix = str.substr(pos);
+  if (suffix == "K" || suffix == "k") return value * 1024;
+  if (suffix == "M" || suffix == "m") return value * MB;
+  if (suffix == "G" || suffix == "g") return value * 1024 * MB;
+  if (!suffix.empty()) throw std::invalid_argument("bad size: " + str);
+  return value;
+}
+
+static void check_choice(const std::string &option, const std::string &value,
+                         const std::vector<std::string> &choices) {
+  for (auto &choice : choices)
+    if (value == choice) return;
+  throw std::invalid_argument("bad value for " + option + ": " + value);
+}
+
+// fill a message with pseudo random bytes
+static void fill_random(char *msg, size_t size, uint64_t &state) {
+  for (size_t i = 0; i < size; i += sizeof(uint64_t)) {
+    state ^= state << 13;
+    state ^= state >> 7;
+    state ^= state << 17;
+    memcpy(msg + i, &state, std::min(sizeof(uint64_t), size - i));
+  }
+}
+
+// Holds the lock around MPI calls when only one thread may call MPI at a time
+class MPILock {
+ private:
+  std::mutex lock;
+  bool serialize;
+ public:
+  MPILock(bool serialize) : serialize(serialize) {}
+  void acquire() { if (serialize) lock.lock(); }
+  void release() { if (serialize) lock.unlock(); }
+};
+
+static int send_message(const std::string &mode, char *msg, size_t size, int dst, int tag,
+                        MPI_Request *request) {
+  if (mode == "send")  return MPI_Send(msg, size, MPI_CHAR, dst, tag, MPI_COMM_WORLD);
+  if (mode == "ssend") return MPI_Ssend(msg, size, MPI_CHAR, dst, tag, MPI_COMM_WORLD);
+  if (mode == "isend") return MPI_Isend(msg, size, MPI_CHAR, dst, tag, MPI_COMM_WORLD, request);
+  return MPI_Issend(msg, size, MPI_CHAR, dst, tag, MPI_COMM_WORLD, request);
+}
+
+static void run_sender_thread(const Config &conf, int tag, int num_recievers, size_t window,
+                              MPILock &mpi_lock) {
+  int dst = 1 + tag % num_recievers;
+  bool nonblocking = conf.send == "isend" || conf.send == "issend";
+  size_t num_buffers = nonblocking ? window : 1;
+  size_t reply_bytes = conf.reply == "echo" ? conf.size : ack_bytes;
+
+  // a buffer may not be modified while its request is outstanding
+  std::vector<std::vector<char>> buffers(num_buffers, std::vector<char>(conf.size, 'x'));
+  std::vector<MPI_Request> requests(num_buffers, MPI_REQUEST_NULL);
+  std::vector<char> reply(reply_bytes);
+  uint64_t state = 0x9E3779B97F4A7C15ull + tag;
+  bool random = conf.content == "random";
+  if (random && conf.prepopulate)
+    for (auto &buffer : buffers) fill_random(buffer.data(), conf.size, state);
+
+  for (size_t i = 0; i < conf.messages; i++) {
+    size_t slot = i % num_buffers;
+    if (requests[slot] != MPI_REQUEST_NULL) {
+      mpi_lock.acquire();
+      MPI_Wait(&requests[slot], MPI_STATUS_IGNORE);
+      mpi_lock.release();
+    }
+    char *msg = buffers[slot].data();
+    if (random && !conf.prepopulate) fill_random(msg, conf.size, state);
+
+    mpi_lock.acquire();
+    send_message(conf.send, msg, conf.size, dst, tag, &requests[slot]);
+    mpi_lock.release();
+
+    if (conf.reply != "none") {
+      mpi_lock.acquire();
+      MPI_Recv(reply.data(), reply_bytes, MPI_CHAR, dst, tag, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+      mpi_lock.release();
+    }
+  }
+  mpi_lock.acquire();
+  MPI_Waitall(num_buffers, requests.data(), MPI_STATUSES_IGNORE);
+  mpi_lock.release();
+}
+
+static void run_reciever(const Config &conf, int proc_id, int num_recievers) {
+  // the sending threads that send to this process
+  std::vector<int> tags;
+  for (int t = 0; t < conf.threads; t++)
+    if (1 + t % num_recievers == proc_id) tags.push_back(t);
+  size_t num_messages = conf.messages * tags.size();
+
+  std::vector<char> msg(conf.size);
+  size_t reply_bytes = conf.reply == "echo" ? conf.size : ack_bytes;
+  // one reply per sending thread, a thread waits for its reply before sending again
+  std::vector<std::vector<char>> replies(conf.threads, std::vector<char>(reply_bytes, 'A'));
+  std::vector<MPI_Request> requests(conf.threads, MPI_REQUEST_NULL);
+
+  for (size_t i = 0; i < num_messages; i++) {
+    MPI_Status status;
+    if (conf.probe) {
+      MPI_Probe(0, MPI_ANY_TAG, MPI_COMM_WORLD, &status);
+      int msg_size;
+      MPI_Get_count(&status, MPI_CHAR, &msg_size);
+      MPI_Recv(msg.data(), msg_size, MPI_CHAR, 0, status.MPI_TAG, MPI_COMM_WORLD, &status);
+    } else {
+      MPI_Recv(msg.data(), conf.size, MPI_CHAR, 0, MPI_ANY_TAG, MPI_COMM_WORLD, &status);
+    }
+
+    if (conf.reply != "none") {
+      int tag = status.MPI_TAG;
+      MPI_Wait(&requests[tag], MPI_STATUS_IGNORE);
+      MPI_Isend(replies[tag].data(), reply_bytes, MPI_CHAR, 0, tag, MPI_COMM_WORLD,
+                &requests[tag]);
+    }
+  }
+  MPI_Waitall(conf.threads, requests.data(), MPI_STATUSES_IGNORE);
+}
+
 int main(int argc, char **argv) {
-  // TODO: Allow threading mode to be configurable
+  // parse the options, every process parses the same matrix
+  std::string thread_level_str = "multiple";
+  std::string threads_str = "1", probe_str = "1", send_str = "send", sizes_str = "100";
+  std::string content_str = "identical", prepopulate_str = "1", reply_str = "ack";
+  std::string format = "csv";
+  size_t num_messages = 0, bytes_per_thread = 256 * MB, window = 8;
+  for (int a = 1; a < argc; a++) {
+    std::string arg = argv[a];
+    size_t eq = arg.find('=');
+    if (arg.compare(0, 2, "--") != 0 || eq == std::string::npos) {
+      std::cerr << "Arguments must be of the form --option=value, got " << arg << std::endl;
+      exit(EXIT_FAILURE);
+    }
+    std::string option = arg.substr(2, eq - 2);
+    std::string value = arg.substr(eq + 1);
+    if (option == "thread_level")     thread_level_str = value;
+    else if (option == "threads")     threads_str = value;
+    else if (option == "probe")       probe_str = value;
+    else if (option == "send")        send_str = value;
+    else if (option == "sizes")       sizes_str = value;
+    else if (option == "messages")    num_messages = std::stoull(value);
+    else if (option == "bytes")       bytes_per_thread = parse_size(value);
+    else if (option == "content")     content_str = value;
+    else if (option == "prepopulate") prepopulate_str = value;
+    else if (option == "reply")       reply_str = value;
+    else if (option == "window")      window = std::max<size_t>(1, std::stoull(value));
+    else if (option == "format")      format = value;
+    else {
+      std::cerr << "Unknown option " << option << std::endl;
+      exit(EXIT_FAILURE);
+    }
+  }
+
+  check_choice("thread_level", thread_level_str, {"single", "funneled", "serialized", "multiple"});
+  check_choice("format", format, {"csv", "json"});
+  int required = MPI_THREAD_SINGLE;
+  if (thread_level_str == "funneled")   required = MPI_THREAD_FUNNELED;
+  if (thread_level_str == "serialized") required = MPI_THREAD_SERIALIZED;
+  if (thread_level_str == "multiple")   required = MPI_THREAD_MULTIPLE;
+
   int provided;
-  MPI_Init_thread(&argc, &argv, MPI_THREAD_SINGLE, &provided);
-  if (provided < MPI_THREAD_SINGLE){
-    std::cout << "ERROR! Could not achieve MPI_THREAD_SINGLE" << std::endl;
+  MPI_Init_thread(&argc, &argv, required, &provided);
+  if (provided < required){
+    std::cout << "ERROR! Could not achieve MPI_THREAD_" << thread_level_str << std::endl;
     exit(EXIT_FAILURE);
   }
   int num_processes = 0;
@@ -32,53 +238,85 @@ int main(int argc, char **argv) {
   if (num_processes < 2) {
     throw std::invalid_argument("number of mpi processes must be at least 2!");
   }
-
-  size_t num_messages  = 1000000;
-  size_t message_bytes = 100;
-  char message[message_bytes];
-
-  size_t ack_bytes = 4;
+  int num_recievers = num_processes - 1;
 
   // Get MPI Rank
   int proc_id;
   MPI_Comm_rank(MPI_COMM_WORLD, &proc_id);
-  if (proc_id > 0) {
-    // prepare ack buffer
-    char ack[ack_bytes] = "ACK\0";
-
-    for (size_t i = 0; i < num_messages; i++) {
-      // Receive message from sender
-      MPI_Recv(message, message_bytes, MPI_CHAR, 0, MPI_ANY_TAG, MPI_COMM_WORLD, nullptr);
-      
-      // Send ack
-      MPI_Send(ack, ack_bytes, MPI_CHAR, 0, 0, MPI_COMM_WORLD);
-    }
 
-    MPI_Finalize();
-  } else {
-    // prepare message
-    for (size_t i = 0; i < message_bytes; i++) {
-      message[i] = i % 93 + 33;
-    }
-    message[message_bytes - 1] = 0;
-
-    auto start = std::chrono::steady_clock::now();
-    for (size_t i = 0; i < num_messages; i++) {
-      // prepare buffer for response
-      char ack_buffer[ack_bytes];
+  // build the matrix of configurations
+  std::vector<Config> configs;
+  for (auto &threads : split(threads_str))
+  for (auto &probe : split(probe_str))
+  for (auto &send : split(send_str))
+  for (auto &size : split(sizes_str))
+  for (auto &content : split(content_str))
+  for (auto &prepopulate : split(prepopulate_str))
+  for (auto &reply : split(reply_str)) {
+    check_choice("send", send, {"send", "ssend", "isend", "issend"});
+    check_choice("content", content, {"random", "identical"});
+    check_choice("reply", reply, {"none", "ack", "echo"});
+    Config conf;
+    conf.threads = std::stoi(threads);
+    conf.probe = probe == "1";
+    conf.send = send;
+    conf.size = parse_size(size);
+    conf.messages = num_messages > 0 ? num_messages
+                                     : std::max<size_t>(1, bytes_per_thread / std::max<size_t>(1, conf.size));
+    conf.content = content;
+    conf.prepopulate = prepopulate == "1";
+    conf.reply = reply;
+    if (conf.threads < 1) throw std::invalid_argument("threads must be at least 1");
+    // only one thread may call MPI below MPI_THREAD_SERIALIZED
+    if (conf.threads > 1 && provided < MPI_THREAD_SERIALIZED) continue;
+    configs.push_back(conf);
+  }
 
-      // send message
-      MPI_Send(message, message_bytes, MPI_CHAR, 1, 0, MPI_COMM_WORLD);
+  MPILock mpi_lock(provided < MPI_THREAD_MULTIPLE);
+  if (proc_id == 0 && format == "csv") {
+    std::cout << "thread_level,threads,recievers,send,probe,size,messages,content,prepopulate,"
+                 "reply,seconds,msgs_per_sec,mib_per_sec,ns_per_msg" << std::endl;
+  }
 
-      // recv ack message
-      MPI_Recv(ack_buffer, ack_bytes, MPI_CHAR, MPI_ANY_SOURCE, MPI_ANY_TAG, MPI_COMM_WORLD, nullptr);
+  for (auto &conf : configs) {
+    MPI_Barrier(MPI_COMM_WORLD);
+    auto start = std::chrono::steady_clock::now();
+    if (proc_id == 0) {
+      std::vector<std::thread> threads;
+      for (int t = 1; t < conf.threads; t++)
+        threads.emplace_back(run_sender_thread, std::cref(conf), t, num_recievers, window,
+                             std::ref(mpi_lock));
+      run_sender_thread(conf, 0, num_recievers, window, mpi_lock);
+      for (auto &thread : threads) thread.join();
+    } else {
+      run_reciever(conf, proc_id, num_recievers);
     }
-
+    MPI_Barrier(MPI_COMM_WORLD); // every message has been recieved
     std::chrono::duration<double> time = std::chrono::steady_clock::now() - start;
-    MPI_Finalize();
-    std::cout << "Total time:          " << time.count() << "(seconds)" << std::endl;
-    std::cout << "Latency per message: " << time.count() / num_messages * 1e9 << "(ns)" << std::endl;
-    std::cout << "Messages per second: " << num_messages / time.count() / 1e6 << "(millions)" << std::endl;
-    std::cout << "Data Throughput:     " << num_messages * message_bytes / time.count() / MB << "(MiB)" << std::endl;
+
+    if (proc_id == 0) {
+      size_t total_messages = conf.messages * conf.threads;
+      double msgs_per_sec = total_messages / time.count();
+      double mib_per_sec = total_messages * conf.size / time.count() / MB;
+      // time per message seen by one sending thread
+      double ns_per_msg = time.count() / conf.messages * 1e9;
+      if (format == "csv") {
+        std::cout << thread_level_str << "," << conf.threads << "," << num_recievers << ","
+                  << conf.send << "," << conf.probe << "," << conf.size << "," << total_messages
+                  << "," << conf.content << "," << conf.prepopulate << "," << conf.reply << ","
+                  << time.count() << "," << msgs_per_sec << "," << mib_per_sec << ","
+                  << ns_per_msg << std::endl;
+      } else {
+        std::cout << "{\"thread_level\": \"" << thread_level_str << "\", \"threads\": "
+                  << conf.threads << ", \"recievers\": " << num_recievers << ", \"send\": \""
+                  << conf.send << "\", \"probe\": " << conf.probe << ", \"size\": " << conf.size
+                  << ", \"messages\": " << total_messages << ", \"content\": \"" << conf.content
+                  << "\", \"prepopulate\": " << conf.prepopulate << ", \"reply\": \""
+                  << conf.reply << "\", \"seconds\": " << time.count() << ", \"msgs_per_sec\": "
+                  << msgs_per_sec << ", \"mib_per_sec\": " << mib_per_sec
+                  << ", \"ns_per_msg\": " << ns_per_msg << "}" << std::endl;
+      }
+    }
   }
+  MPI_Finalize();
 }
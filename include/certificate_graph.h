@@ -0,0 +1,62 @@
+#pragma once
+#include <types.h>
+
+#include <set>
+#include <vector>
+
+/*
+ * A weighted, undirected graph stored in compressed sparse row format.
+ * It is built from the union of k spanning forests returned by
+ * GraphDistribUpdate::k_spanning_forests(). This union is a sparse certificate
+ * for k-edge-connectivity: its minimum cut equals that of the full graph
+ * whenever the full graph's minimum cut is less than k.
+ */
+class CertificateGraph {
+ private:
+  node_id_t num_vertices;
+  std::vector<size_t> offsets;     // edges of vertex v are in [offsets[v], offsets[v+1])
+  std::vector<node_id_t> targets;  // the other endpoint of each edge
+  std::vector<uint64_t> weights;   // the weight of each edge
+
+  CertificateGraph() = default;
+
+  // minimum weighted degree of any vertex
+  uint64_t min_degree() const;
+
+  /*
+   * Contract edges that pass the Padberg-Rinaldi tests: edges of weight at
+   * least lambda and edges holding at least half of an endpoint's degree.
+   * @return  the number of vertices after contraction
+   */
+  node_id_t padberg_rinaldi(uint64_t lambda, std::vector<node_id_t> &labels) const;
+
+  /*
+   * Scan the graph in maximum adjacency order (CAPFOREST of Nagamochi and
+   * Ibaraki) and mark edges whose endpoints are at least lambda-connected.
+   * @param lambda  an upper bound on the minimum cut
+   * @param labels  filled with the contracted vertex of each vertex
+   * @return        the number of vertices after contraction
+   */
+  node_id_t capforest(uint64_t lambda, std::vector<node_id_t> &labels) const;
+
+  // build the graph that results from contracting vertices with the same label
+  CertificateGraph contract(const std::vector<node_id_t> &labels, node_id_t new_vertices) const;
+
+ public:
+  /*
+   * Build the certificate from an adjacency list where each edge appears in
+   * the set of exactly one of its endpoints.
+   */
+  CertificateGraph(const std::vector<std::set<node_id_t>> &adj_list);
+
+  node_id_t get_num_vertices() const { return num_vertices; }
+  size_t get_num_edges() const { return targets.size() / 2; }
+
+  /*
+   * Returns the exact weight of a minimum cut of this graph, 0 if the
+   * graph is disconnected or has fewer than two vertices.
+   * Uses the deterministic algorithm of Nagamochi, Ono, and Ibaraki with a
+   * priority queue bounded by the current cut estimate.
+   */
+  uint64_t min_cut() const;
+};
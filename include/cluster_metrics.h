@@ -0,0 +1,200 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <vector>
+
+#include "worker_cluster.h"
+
+// Stages of the path an update takes from the guttering system back into the sketches
+enum MetricStage {
+  GUTTER_WAIT,     // WorkDistributor waiting for a full batch from the guttering system
+  SERIALIZE,       // serializing batches into a BATCH message
+  SEND,            // sending a BATCH message to the message forwarder
+  REMOTE_COMPUTE,  // DistributedWorker generating and serializing the deltas of a message
+  DELTA_RECV,      // WorkDistributor waiting for and recieving a DELTA message
+  DELTA_APPLY,     // applying the deltas of a DELTA message to the sketches
+  NUM_STAGES
+};
+
+/*
+ * A lock free histogram of nanosecond latencies in the style of an HDR
+ * histogram. Each power of two is divided into sub_buckets linear buckets, so
+ * any recorded value is known to within 1/sub_buckets of its magnitude.
+ */
+class LatencyHistogram {
+ private:
+  static constexpr int sub_bucket_bits = 3;
+  static constexpr uint64_t sub_buckets = 1 << sub_bucket_bits;
+  static constexpr size_t num_buckets = sub_buckets * (64 - sub_bucket_bits + 1);
+
+  std::atomic<uint64_t> buckets[num_buckets];
+  std::atomic<uint64_t> count;
+  std::atomic<uint64_t> sum;
+  std::atomic<uint64_t> max;
+
+ public:
+  LatencyHistogram() { reset(); }
+
+  static size_t bucket_of(uint64_t ns);
+  static uint64_t bucket_upper(size_t bucket); // the largest value recorded in a bucket
+
+  void record(uint64_t ns);
+  void reset();
+
+  uint64_t get_count() const { return count; }
+  uint64_t get_sum() const { return sum; }
+  uint64_t get_max() const { return max; }
+  // the recorded value at or below which a fraction q of the values lie
+  uint64_t percentile(double q) const;
+  // number of recorded values below ns, exact when ns is a power of two
+  uint64_t count_below(uint64_t ns) const;
+};
+
+// Bytes of memory held by each component of a process
+struct MemoryReport {
+  struct Component {
+    const char *name;
+    size_t bytes;
+    bool estimated; // taken from the MemoryPlan because the memory is not visible to Landscape
+  };
+  std::vector<Component> components;
+
+  void add(const char *name, size_t bytes, bool estimated = false) {
+    components.push_back({name, bytes, estimated});
+  }
+  size_t total() const {
+    size_t bytes = 0;
+    for (auto &component : components) bytes += component.bytes;
+    return bytes;
+  }
+  friend std::ostream &operator<<(std::ostream &out, const MemoryReport &report);
+};
+
+// Memory of a DistributedWorker by component, see DistributedWorker::memory_report()
+struct WorkerMemory {
+  uint64_t arena_bytes;       // supernode arena holding delta_node and the deltas of every handler
+  uint64_t msg_buffer_bytes;  // message buffers allocated by the MsgBufferPool
+  uint64_t handler_bytes;     // BatchesToDeltasHandlers and their queue elements
+
+  MemoryReport report() const {
+    MemoryReport report;
+    report.add("delta supernodes", arena_bytes);
+    report.add("message buffers", msg_buffer_bytes);
+    report.add("batch handlers", handler_bytes);
+    return report;
+  }
+};
+
+// A DistributedWorker's report of its recent activity, sent as a TELEMETRY message
+struct WorkerTelemetry {
+  int worker_id;
+  uint32_t num_handlers;      // BatchesToDeltasHandlers of the worker
+  uint32_t idle_handlers;     // handlers waiting for a BATCH message
+  uint32_t pending_deltas;    // handlers whose deltas are waiting to be sent
+  uint64_t num_updates;       // updates processed this session
+  uint64_t batch_msgs;        // BATCH messages processed this session
+  double utilization;         // fraction of helper thread time spent generating deltas
+  uint64_t delta_gen_p50_ns;  // time to generate the deltas of a message since the last report
+  uint64_t delta_gen_p99_ns;
+  uint64_t delta_gen_max_ns;
+  uint64_t memory_bytes;      // sum of the memory components
+  WorkerMemory memory;
+};
+
+// Load on one stage of the update path over an ingestion session
+struct StageLoad {
+  const char *name;
+  double busy;       // fraction of the stage's time spent working, -1 if not measured
+  double idle;       // fraction of the stage's time spent waiting for work, -1 if not measured
+  double occupancy;  // mean fraction of the stage's queue that is full, -1 if it has no queue
+  double load() const { return std::max(busy, occupancy); }
+};
+
+/*
+ * Which stage of the update path bounded the throughput of an ingestion
+ * session. The stage with the greatest load, the larger of its busy fraction
+ * and queue occupancy, is the bottleneck.
+ */
+struct BottleneckReport {
+  double seconds = 0;               // time spent ingesting, excluding pauses for queries
+  std::vector<StageLoad> stages;
+  int bottleneck = -1;              // index of the bounding stage, -1 if nothing was measured
+
+  void write_json(std::ostream &out) const;
+  friend std::ostream &operator<<(std::ostream &out, const BottleneckReport &report);
+};
+
+/*
+ * Process wide latency histograms for each MetricStage and the number of
+ * messages and bytes sent and recieved for each MessageCode. The leader
+ * also keeps the latest TELEMETRY report of every worker and exports all of
+ * them in the Prometheus text format.
+ */
+class ClusterMetrics {
+ private:
+  static constexpr int max_message_codes = 16;
+  struct MessageCounters {
+    std::atomic<uint64_t> messages{0};
+    std::atomic<uint64_t> bytes{0};
+  };
+
+  static LatencyHistogram stages[NUM_STAGES];
+  static MessageCounters sent[max_message_codes];
+  static MessageCounters recieved[max_message_codes];
+
+  // latest TELEMETRY report of each worker and its averages over the session
+  struct WorkerRecord {
+    WorkerTelemetry latest;
+    uint64_t arrival_ns;          // when the latest report arrived
+    double busy_ns = 0;           // utilization weighted by the time each report covers
+    uint64_t covered_ns = 0;
+    double handler_occupancy = 0; // summed over reports
+    double delta_occupancy = 0;
+    uint64_t num_reports = 0;
+  };
+  static std::mutex telemetry_lock;
+  static std::map<int, WorkerRecord> telemetry;
+  static uint64_t session_start_ns;
+
+ public:
+  static uint64_t now_ns() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+  }
+
+  static void record(MetricStage stage, uint64_t ns) { stages[stage].record(ns); }
+  static void count_sent(MessageCode code, size_t bytes);
+  static void count_recieved(MessageCode code, size_t bytes);
+
+  static const LatencyHistogram &get_histogram(MetricStage stage) { return stages[stage]; }
+  static uint64_t get_bytes_sent(MessageCode code) { return sent[code].bytes; }
+  static uint64_t get_bytes_recieved(MessageCode code) { return recieved[code].bytes; }
+
+  static void reset();
+
+  // store the latest TELEMETRY report of a worker
+  static void record_telemetry(const WorkerTelemetry &report);
+  static std::vector<WorkerTelemetry> get_telemetry();
+  // workers whose median delta generation time is over twice the cluster's median
+  static std::vector<int> get_stragglers();
+
+  /*
+   * Attribute the throughput of the session since the last reset() to a stage.
+   * @param active_seconds    time spent ingesting, excluding pauses for queries
+   * @param num_distributors  WorkDistributors whose threads recorded the stages
+   */
+  static BottleneckReport bottleneck_report(double active_seconds, int num_distributors);
+
+  static const char *stage_name(MetricStage stage);
+  static const char *message_name(MessageCode code);
+
+  // write every histogram and message counter in the Prometheus text format
+  static void write_prometheus(std::ostream &out);
+  // write the memory of each component of the leader in the Prometheus text format
+  static void write_leader_memory(std::ostream &out, const MemoryReport &leader_memory);
+};
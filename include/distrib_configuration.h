@@ -0,0 +1,68 @@
+#pragma once
+#include <iostream>
+#include <string>
+
+// Memory in bytes and cores available to the leader and to each worker
+struct ResourceBudget {
+  size_t leader_bytes = 0;
+  size_t worker_bytes = 0;
+  unsigned leader_cores = 0;
+  unsigned worker_cores = 0;
+};
+
+/*
+ * Options for a GraphDistribUpdate that are not required to construct it.
+ * Setters return the configuration so they may be chained.
+ */
+class DistribConfiguration {
+ private:
+  // Where query backups are placed. Backing up in memory copies every supernode
+  // before each continuous query, doubling peak memory on the leader. Backing up
+  // to disk only writes the supernodes that Boruvka will modify.
+  bool _backup_in_mem = true;
+  std::string _backup_dir = "./";
+
+  // Vertices with at most this many pending edges are kept exact on the leader
+  // instead of being sketched by the cluster. Zero disables the hybrid mode.
+  size_t _low_degree_threshold = 0;
+
+  // Place supernodes on the NUMA node that owns their id range and pin the
+  // WorkDistributor threads round-robin across NUMA nodes.
+  bool _numa_aware = false;
+
+  // The leader periodically writes its ClusterMetrics to this file in the
+  // Prometheus text format. Empty disables the metrics file.
+  std::string _metrics_file = "cluster_metrics.prom";
+
+  // When the WorkDistributors stop the leader writes which stage bounded
+  // throughput to this file as JSON. Empty disables the report file.
+  std::string _bottleneck_file = "bottleneck_report.json";
+
+  // If set, buffering parameters are derived from the budget by MemoryPlan
+  bool _use_budget = false;
+  ResourceBudget _budget;
+
+  friend class GraphDistribUpdate;
+  friend class MemoryPlan;
+ public:
+  DistribConfiguration() = default;
+
+  // if false then query backups are written to the backup directory
+  DistribConfiguration &backup_in_mem(bool backup_in_mem);
+  // directory for query backups, ideally on a local SSD
+  DistribConfiguration &backup_dir(std::string backup_dir);
+  // maximum number of pending edges kept exactly per vertex, 0 to sketch every update
+  DistribConfiguration &low_degree_threshold(size_t threshold);
+  // place supernodes and WorkDistributor threads across the leader's NUMA nodes
+  DistribConfiguration &numa_aware(bool numa_aware);
+  // file the leader's metrics are written to, empty to disable
+  DistribConfiguration &metrics_file(std::string metrics_file);
+  // file the bottleneck report of each session is written to, empty to disable
+  DistribConfiguration &bottleneck_file(std::string bottleneck_file);
+  // size the guttering system and message buffers to fit within budget
+  DistribConfiguration &memory_budget(ResourceBudget budget);
+
+  friend std::ostream &operator<<(std::ostream &out, const DistribConfiguration &conf);
+
+  DistribConfiguration(const DistribConfiguration &) = default;
+};
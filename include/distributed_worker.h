@@ -2,10 +2,13 @@
 #include <types.h>
 #include <vector>
 #include <atomic>
+#include <utility>
 
 #include "msg_buffer_queue.h"
 #include <supernode.h>
 #include "memstream.h"
+#include "supernode_arena.h"
+#include "cluster_metrics.h"
 
 class DistributedWorker {
 private:
@@ -16,32 +19,20 @@ private:
   // class for coordinating recieving batches and sending deltas
   class BatchesToDeltasHandler {
    public:
-    char* serial_delta_mem;       // where we serialize the deltas
-    char* batches_buffer;         // where we place the batches message
-    std::vector<delta_t> deltas;  // where we place the generated deltas
-    omemstream serial_stream;
+    // message buffers come from the MsgBufferPool and are sized to their contents
+    char* batches_buffer = nullptr; // where we place the batches message
+    char* delta_msg = nullptr;      // where we serialize the deltas
+    size_t delta_msg_size = 0;
+    std::vector<delta_t> deltas;    // where we place the generated deltas
     int msg_src;
 
-    BatchesToDeltasHandler(int max_msg_size, size_t size) 
-      : serial_delta_mem(new char[max_msg_size * sizeof(char)]),
-        batches_buffer(new char[max_msg_size * sizeof(char)]),
-        serial_stream(serial_delta_mem, max_msg_size) {
-      //  std::cout << "BatchesToDeltas with size = " << deltas.size() << std::endl;
-      for (size_t i = 0; i < size; i++)
-        deltas.push_back({0, (Supernode*)new char[Supernode::get_size()]});
-    }
+    // the delta supernodes are slots of the worker's arena, see prepare_handlers()
+    BatchesToDeltasHandler(size_t size) : deltas(size, {0, nullptr}) {}
 
     BatchesToDeltasHandler(BatchesToDeltasHandler&& oth)
-        : serial_delta_mem(std::exchange(oth.serial_delta_mem, nullptr)),
-          batches_buffer(std::exchange(oth.batches_buffer, nullptr)), deltas(std::move(oth.deltas)), 
-          serial_stream(std::move(oth.serial_stream)) {};
-
-    ~BatchesToDeltasHandler() {
-      delete[] batches_buffer;
-      delete[] serial_delta_mem;
-      for (auto& delta : deltas)
-        delete[] delta.supernode;
-    }
+        : batches_buffer(std::exchange(oth.batches_buffer, nullptr)),
+          delta_msg(std::exchange(oth.delta_msg, nullptr)), delta_msg_size(oth.delta_msg_size),
+          deltas(std::move(oth.deltas)), msg_src(oth.msg_src) {};
 
     BatchesToDeltasHandler(const BatchesToDeltasHandler&) = delete;
     BatchesToDeltasHandler& operator=(const BatchesToDeltasHandler&) = delete;
@@ -56,22 +47,36 @@ private:
   MsgBufferQueue<BatchesToDeltasHandler> send_msg_queue;
 
   static constexpr int init_msg_size =
-      sizeof(seed) + sizeof(num_nodes) + sizeof(max_msg_size) + sizeof(double);
+      sizeof(seed) + sizeof(num_nodes) + sizeof(max_msg_size) + sizeof(double) + sizeof(int);
   bool running = true; // is cluster active
 
-  // variables for storing messages to this worker
-  char *msg_buffer;
-  int msg_size;
+  int msg_size; // size of the last message recieved
 
   Supernode *delta_node; // the supernode object used to generate deltas
+  SupernodeArena supernode_arena; // memory for delta_node and the deltas of every handler
   int id; // id of the distributed worker
   size_t helper_threads;  // number of helper threads that will process deltas for the main thread
+  size_t num_handlers;    // number of BatchesToDeltasHandlers requested for this session
+  size_t num_allocated_handlers = 0;
 
   std::atomic<size_t> num_updates; // number of updates processed by this node
 
+  // activity reported to main in TELEMETRY messages, see send_telemetry()
+  static constexpr uint64_t telemetry_interval_ns = 1000000000;
+  std::atomic<uint64_t> num_batch_msgs; // BATCH messages processed this session
+  std::atomic<uint64_t> busy_ns;        // time spent generating deltas this session
+  LatencyHistogram delta_gen_time;      // per message delta generation time since the last report
+  uint64_t last_report_ns = 0;
+  uint64_t last_report_busy_ns = 0;
+
   // wait for initialize message
   void init_worker();
+  // allocate the handlers this session requires and point delta_node and the
+  // handler deltas at arena slots sized for the session's supernodes
+  void prepare_handlers();
   void process_send_queue_elm();
+  // report this worker's activity since the last report to main through dst_id
+  void send_telemetry(int dst_id);
 public:
   // Create a distributed worker and run
   DistributedWorker(int _id);
@@ -79,4 +84,7 @@ public:
 
   // main loop of the distributed worker
   void run();
+
+  // memory of this worker's supernodes, message buffers and handlers
+  WorkerMemory memory_report() const;
 };
@@ -1,32 +1,368 @@
 #pragma once
 #include <graph.h>
 #include <supernode.h>
+#include "cluster_metrics.h"
+#include "distrib_configuration.h"
+#include "low_degree_adjacency.h"
+#include "memory_planner.h"
+#include "numa_topology.h"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <fstream>
+#include <functional>
+#include <future>
+#include <mutex>
+#include <string>
+#include <thread>
+
+/*
+ * Bounds on how stale a cached query answer may be. A cached answer is reused
+ * if it is missing at most max_updates stream updates OR if it was computed
+ * within the last max_age (a max_age of zero disables the time bound).
+ * The default only accepts answers that reflect every stream update.
+ */
+struct QueryStaleness {
+  uint64_t max_updates = 0;
+  std::chrono::milliseconds max_age{0};
+};
+
+/*
+ * A connectivity snapshot emitted periodically by GraphDistribUpdate
+ * along with the latency of the query that produced it.
+ */
+struct ConnectivitySnapshot {
+  size_t index;                                  // number of snapshots before this one
+  uint64_t num_updates;                          // stream updates inserted before the query
+  std::vector<std::set<node_id_t>> components;   // the connected components
+  double flush_latency;                          // seconds spent flushing the stream
+  double alg_latency;                            // seconds spent in the CC algorithm
+};
+
+/*
+ * Seconds spent in each phase of a query. Phases that a query skips,
+ * for example all but result when a cached answer is reused, are zero.
+ */
+struct QueryPhases {
+  double flush = 0;    // quiesce the inserters and force_flush the guttering system
+  double pause = 0;    // pause_workers and apply the low degree edges
+  double boruvka = 0;  // boruvka_emulation, including the copy or backup of the sketches
+  double result = 0;   // build the answer from the DSU or spanning forests
+  double reset = 0;    // reset_query_state of every supernode
+  double unpause = 0;  // unpause_workers
+  bool cached = false; // the answer was reused from a previous query
+
+  static constexpr int num_phases = 6;
+  static const char *name(int phase) {
+    static const char *names[num_phases] = {"flush", "pause", "boruvka",
+                                            "result", "reset", "unpause"};
+    return names[phase];
+  }
+  double get(int phase) const {
+    const double values[num_phases] = {flush, pause, boruvka, result, reset, unpause};
+    return values[phase];
+  }
+  double total() const { return flush + pause + boruvka + result + reset + unpause; }
+};
 
 class GraphDistribUpdate : public Graph {
 private:
   FRIEND_TEST(DistributedGraphTest, TestSupernodeRestoreAfterCCFailure);
 
-  static GraphConfiguration graph_conf(node_id_t num_nodes, node_id_t k);
+  // check the arguments of a graph and plan its memory, sizing Supernodes for it
+  static MemoryPlan plan_graph(node_id_t num_nodes, node_id_t k, int num_inserters,
+                               const DistribConfiguration &conf);
+  static GraphConfiguration graph_conf(node_id_t k, const DistribConfiguration &conf,
+                                       const MemoryPlan &plan);
+  GraphDistribUpdate(node_id_t num_nodes, int num_inserters, node_id_t k,
+                     DistribConfiguration conf, const MemoryPlan &plan);
   node_id_t k = 1; // this parameter determines the value of k for is_k_connected()
+  DistribConfiguration distrib_conf;
+  MemoryPlan memory_plan; // buffering parameters, identical to those given to the Graph
+  unsigned reset_threads; // number of threads used to reset supernode query state
+
+  // disable the GraphWorkers and start the distributed cluster
+  void init_distributed();
+
+  // NUMA nodes of the leader, nullptr unless the configuration is numa_aware
+  NumaTopology *numa = nullptr;
+  // move each supernode to memory first touched by a cpu of its NUMA node
+  void place_supernodes();
+
+  // the first bytes of a checkpoint file. Supernodes begin at checkpoint_header_size.
+  struct CheckpointHeader {
+    char magic[8];
+    uint64_t num_nodes;
+    uint64_t seed;
+    uint64_t k;
+    uint64_t serialized_size; // bytes per serialized supernode
+  };
+  static constexpr size_t checkpoint_header_size = 4096;
+  static constexpr size_t checkpoint_block_size = 64 * 1024 * 1024; // bytes per read or write
+  static CheckpointHeader read_checkpoint_header(const std::string &checkpoint_file);
+  GraphDistribUpdate(const CheckpointHeader &header, const std::string &checkpoint_file,
+                     int num_inserters, DistribConfiguration conf)
+      : GraphDistribUpdate(header, checkpoint_file, num_inserters, conf,
+                           plan_graph(header.num_nodes, header.k, num_inserters, conf)) {}
+  GraphDistribUpdate(const CheckpointHeader &header, const std::string &checkpoint_file,
+                     int num_inserters, DistribConfiguration conf, const MemoryPlan &plan);
+  // parallel block I/O of every supernode, returns the number of bytes transferred
+  size_t write_supernodes(int fd);
+  size_t read_supernodes(int fd);
+
+  // exact edges of low degree vertices, nullptr if the hybrid mode is disabled
+  LowDegreeAdjacency *low_degree = nullptr;
+  void insert_low_degree(GraphUpdate upd, int thr_id);
+  // join the components of the DSU, false if a and b were already in one component
+  bool merge_components(node_id_t a, node_id_t b);
+  /*
+   * Merge the exact low degree edges into the components the sketches produced,
+   * adding the edges that join components to the spanning forest.
+   * Inserters must be quiet. @return  true if any components were merged
+   */
+  bool merge_low_degree_edges();
+  // toggle each edge in the supernodes of both its endpoints
+  void toggle_in_supernodes(const std::vector<Edge> &edges);
+
+  /*
+   * With several leaders each leader owns a range of node ids. A leader keeps
+   * the edges with an endpoint in its range, in the sketches of both endpoints,
+   * so its sketches describe the subgraph of those edges. The union of the
+   * leaders' components is then the components of the graph.
+   */
+  node_id_t leader_first = 0;
+  node_id_t leader_last = 0;
+  inline bool owns_edge(Edge edge) const {
+    return (edge.src >= leader_first && edge.src < leader_last) ||
+           (edge.dst >= leader_first && edge.dst < leader_last);
+  }
+  // join the components of every leader, collective over the leaders
+  std::vector<std::set<node_id_t>> merge_leader_components(
+      const std::vector<std::set<node_id_t>> &components) const;
+  // throw if the graph has several leaders, query names the unsupported operation
+  static void require_single_leader(const std::string &query);
+
+  // route an update to the guttering system or the exact low degree adjacency
+  inline void insert_update(GraphUpdate upd, int thr_id) {
+    if (!owns_edge(upd.edge)) return; // another leader sketches this edge
+    if (low_degree == nullptr) Graph::update(upd, thr_id);
+    else insert_low_degree(upd, thr_id);
+  }
+  // route a batch of updates, inserting them into the guttering system grouped by node
+  void insert_updates(const GraphUpdate *upds, size_t num_upds, int thr_id);
+
+  QueryPhases query_phases; // the time spent in each phase of the running query
+  // flush every stream update to the supernodes, the workers remain paused afterwards
+  void flush_for_query();
+  // get_connected_components() and k_spanning_forests() for a caller that holds query_lock
+  std::vector<std::set<node_id_t>> connected_components_locked(bool cont,
+      QueryStaleness staleness);
+  std::vector<std::set<node_id_t>> k_spanning_forests_locked(node_id_t user_k,
+      QueryStaleness staleness);
+  // reset the query state of every supernode in parallel and resume ingestion
+  void resume_after_query();
+
+  // state of each inserter thread, padded so that the inserters do not share cache lines
+  struct InserterState {
+    std::atomic<uint64_t> count{0};          // number of stream updates by this inserter
+    std::atomic<bool> in_update{false};      // is the inserter inserting to the gts
+    std::atomic<bool> has_deferred{false};   // are there updates in deferred
+    std::mutex deferred_lock;
+    std::vector<GraphUpdate> deferred;       // updates buffered while a query was running
+    char padding[64];
+  };
+  InserterState *inserters;
+  int num_inserters;
+
+  // Queries stop the inserters from touching the guttering system by raising
+  // query_pending. Inserters that see it buffer their updates instead of blocking.
+  std::atomic<bool> query_pending{false};
+  mutable std::mutex query_lock; // only one query runs at a time
+
+  // wait for every inserter to leave the guttering system and apply buffered updates
+  void quiesce_inserters();
+  // let inserters write to the guttering system again
+  void release_inserters() { query_pending = false; }
+  void defer_updates(InserterState &ins, const GraphUpdate *upds, size_t num_upds);
+  void replay_deferred(InserterState &ins, int thr_id);
+
+  // queries submitted through the asynchronous interface that have not finished
+  std::mutex async_lock;
+  std::condition_variable async_cond;
+  size_t async_outstanding = 0;
+
+  template <class Ret, class Query>
+  std::future<Ret> submit_query(Query query);
+
+  // periodic connectivity snapshots
+  std::thread snapshot_thread;
+  std::mutex snapshot_lock;
+  std::condition_variable snapshot_cond;
+  bool snapshot_stop = false;
+  uint64_t snapshot_update_interval = 0;
+  std::chrono::milliseconds snapshot_time_interval{0};
+  std::function<void(const ConnectivitySnapshot &)> snapshot_callback;
+  std::ofstream snapshot_out;
+  void snapshot_loop();
+
+  // the position in the stream at which a cached query answer was computed
+  struct QuerySnapshot {
+    bool valid = false;
+    uint64_t num_updates = 0;
+    std::chrono::steady_clock::time_point time;
+  };
+  QuerySnapshot dsu_snapshot; // the DSU answers both CC and point queries
+  QuerySnapshot kf_snapshot;  // the result of the last k_spanning_forests
+  node_id_t kf_cache_k = 0;
+  std::vector<std::set<node_id_t>> kf_cache;
+
+  bool is_fresh(const QuerySnapshot &snapshot, QueryStaleness staleness) const;
+
+  // bytes of the DSU, spanning forest and cached forests. Measured by
+  // memory_report() under query_lock once the query state has changed.
+  uint64_t query_state_version = 0;       // incremented by queries that change the state
+  mutable uint64_t measured_version = -1; // the version query_state_bytes describes
+  mutable std::atomic<size_t> query_state_bytes{0};
+  void measure_query_state() const;
 public:
   // constructor
-  GraphDistribUpdate(node_id_t num_nodes, int num_inserters, node_id_t k = 1);
+  GraphDistribUpdate(node_id_t num_nodes, int num_inserters, node_id_t k = 1)
+      : GraphDistribUpdate(num_nodes, num_inserters, k, DistribConfiguration()) {}
+  GraphDistribUpdate(node_id_t num_nodes, int num_inserters, node_id_t k,
+                     DistribConfiguration conf);
+  // restore a graph from a file written by checkpoint()
+  GraphDistribUpdate(const std::string &checkpoint_file, int num_inserters,
+                     DistribConfiguration conf = DistribConfiguration());
   ~GraphDistribUpdate();
 
   // some getter functions
   node_id_t get_num_nodes() const {return num_nodes;}
   uint64_t get_seed() const {return seed;}
   Supernode *get_supernode(node_id_t src) const { return supernodes[src]; }
+  Supernode *const *get_supernodes() const { return supernodes; }
+  const MemoryPlan &get_memory_plan() const { return memory_plan; }
+  const NumaTopology *get_numa_topology() const { return numa; }
+  const std::string &get_metrics_file() const { return distrib_conf._metrics_file; }
+  const std::string &get_bottleneck_file() const { return distrib_conf._bottleneck_file; }
+
+  // the node ids [first, last) this leader owns, every node id with one leader
+  std::pair<node_id_t, node_id_t> get_leader_range() const { return {leader_first, leader_last}; }
+
+  // total number of stream updates given to this graph
+  uint64_t get_num_updates() const;
+
+  /*
+   * Bytes of memory held by each component of the leader. The guttering
+   * system and query backup are managed by the Graph, so their sizes are the
+   * estimates of the MemoryPlan. Each worker's memory arrives in its
+   * TELEMETRY reports, see ClusterMetrics::get_telemetry().
+   */
+  MemoryReport memory_report() const;
+
+  /*
+   * Insert an update to the graph. Safe to call while a query is running on
+   * another thread, in which case the update is buffered and inserted once
+   * the query no longer needs the guttering system to be quiet.
+   */
+  inline void update(GraphUpdate upd, int thr_id = 0) {
+    InserterState &ins = inserters[thr_id];
+
+    // sequentially consistent to pair with quiesce_inserters()
+    ins.in_update.store(true);
+    if (query_pending.load()) {
+      ins.in_update.store(false, std::memory_order_release);
+      defer_updates(ins, &upd, 1);
+    } else {
+      try {
+        if (ins.has_deferred.load(std::memory_order_relaxed)) replay_deferred(ins, thr_id);
+        insert_update(upd, thr_id);
+      } catch (...) {
+        ins.in_update.store(false, std::memory_order_release);
+        throw;
+      }
+      ins.in_update.store(false, std::memory_order_release);
+    }
+
+    // only this thread writes its counter so a relaxed increment is sufficient
+    ins.count.store(ins.count.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+  }
+
+  /*
+   * Insert num_upds updates to the graph, equivalent to calling update() on
+   * each of them but with the per update overhead paid once per chunk of
+   * updates. Within a chunk the updates are inserted into the guttering
+   * system grouped by node. Like update(), safe to call during a query.
+   */
+  void update_batch(const GraphUpdate *upds, size_t num_upds, int thr_id = 0);
+  // updates inserted by update_batch() between checks for a pending query
+  static constexpr size_t update_batch_chunk = 4096;
+
+  /*
+   * Queries may reuse the answer of a previous query if it satisfies the
+   * given staleness bounds. Otherwise the guttering system is flushed and
+   * the answer is computed from the sketches.
+   * With several leaders, get_connected_components() is collective: every
+   * leader must call it and each receives the components of the whole graph.
+   * The other queries require a single leader.
+   * @param phases  if not null, receives the time the query spent in each phase
+   */
+  std::vector<std::set<node_id_t>> get_connected_components(bool cont = false,
+      QueryStaleness staleness = QueryStaleness(), QueryPhases *phases = nullptr);
+  std::vector<std::set<node_id_t>> k_spanning_forests(node_id_t user_k,
+      QueryStaleness staleness = QueryStaleness(), QueryPhases *phases = nullptr);
+  bool point_to_point_query(node_id_t a, node_id_t b,
+      QueryStaleness staleness = QueryStaleness(), QueryPhases *phases = nullptr);
 
-  std::vector<std::set<node_id_t>> get_connected_components(bool cont = false);
-  std::vector<std::set<node_id_t>> k_spanning_forests(node_id_t user_k);
-  bool point_to_point_query(node_id_t a, node_id_t b);
+  /*
+   * Exact edge connectivity of the graph computed from the union of k
+   * spanning forests, which preserves every cut of size less than k.
+   * @return  the size of a minimum cut, or k if the minimum cut is at least k
+   */
+  node_id_t min_cut(QueryStaleness staleness = QueryStaleness(), QueryPhases *phases = nullptr);
+  // is the minimum cut of the graph at least user_k? Requires user_k <= k
+  bool is_k_edge_connected(node_id_t user_k, QueryStaleness staleness = QueryStaleness(),
+                           QueryPhases *phases = nullptr);
+
+  /*
+   * Write the sketches, seed, and k to checkpoint_file so that the graph may be
+   * restored without replaying the stream. The guttering system is flushed
+   * first. Inserters may continue to call update() while the sketches are
+   * written; their updates are held in the guttering system until it finishes.
+   */
+  void checkpoint(const std::string &checkpoint_file);
+
+  /*
+   * Asynchronous versions of the continuous queries. The query runs on its
+   * own thread and inserters may keep calling update() while it does.
+   * Queries are performed one at a time in the order they acquire the graph.
+   */
+  std::future<std::vector<std::set<node_id_t>>> submit_cc_query(
+      QueryStaleness staleness = QueryStaleness());
+  std::future<bool> submit_point_query(node_id_t a, node_id_t b,
+      QueryStaleness staleness = QueryStaleness());
+
+  /*
+   * Begin emitting connectivity snapshots while the stream is ingested.
+   * A snapshot is taken once update_interval updates have been inserted or
+   * time_interval has passed since the last snapshot, whichever comes first.
+   * An interval of zero disables that trigger.
+   * @param callback     called with each snapshot (may be empty)
+   * @param output_file  if not empty, a csv line per snapshot is appended here
+   */
+  void start_snapshots(uint64_t update_interval, std::chrono::milliseconds time_interval,
+                       std::function<void(const ConnectivitySnapshot &)> callback,
+                       const std::string &output_file = "");
+  void stop_snapshots(); // stop emitting snapshots, waits for an in-progress snapshot
 
   /*
    * This function must be called at the beginning of the program
    * its job is to direct the workers to the DistributedWorker class
+   * @param num_leaders  the number of leader processes. The MPI processes are
+   *                     divided into this many clusters, each with a leader
+   *                     that constructs its own GraphDistribUpdate.
    */
-  static void setup_cluster(int argc, char** argv);
+  static void setup_cluster(int argc, char** argv, int num_leaders = 1);
   /*
    * This function must be called at the end of the program
    * its job is to finalize all the MPI processes
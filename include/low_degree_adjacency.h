@@ -0,0 +1,65 @@
+#pragma once
+#include <types.h>
+
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+/*
+ * Exact adjacency for vertices that have seen few updates. Each vertex keeps
+ * up to threshold edges in a fixed size slot of a flat array. An edge is kept
+ * exactly, in the slots of both endpoints, while neither endpoint is promoted.
+ * Such edges are never sent to the cluster or applied to a sketch; queries
+ * merge them into the components found from the sketches. A vertex whose slot
+ * overflows is promoted: its exact edges move to the sketches and from then
+ * on every edge of the vertex goes through the guttering system.
+ */
+class LowDegreeAdjacency {
+ private:
+  node_id_t num_nodes;
+  size_t threshold;
+  std::vector<node_id_t> edges;  // threshold entries per vertex
+  std::vector<uint8_t> state;    // number of exact edges, or promoted_state
+
+  static constexpr size_t num_stripes = 4096;
+  std::mutex *locks;             // vertex v is protected by locks[v % num_stripes]
+  std::mutex promote_lock;       // one promotion at a time, it locks many stripes
+
+  node_id_t *slot(node_id_t v) { return edges.data() + (size_t)v * threshold; }
+  bool remove(node_id_t v, node_id_t dst); // remove dst from the slot of v if present
+  // move the exact edges of v to spill, removing them from its neighbors' slots
+  void promote(node_id_t v, std::vector<Edge> &spill);
+
+ public:
+  static constexpr uint8_t promoted_state = UINT8_MAX;
+  static constexpr size_t max_threshold = promoted_state - 1;
+
+  LowDegreeAdjacency(node_id_t num_nodes, size_t threshold);
+  ~LowDegreeAdjacency();
+  LowDegreeAdjacency(const LowDegreeAdjacency &) = delete;
+  LowDegreeAdjacency &operator=(const LowDegreeAdjacency &) = delete;
+
+  /*
+   * Toggle the edge (a, b). Thread safe with respect to other calls to toggle().
+   * @param spill  if the toggle promotes a vertex, the exact edges that left the
+   *               exact adjacency are appended here
+   * @return       false if (a, b) is not kept exactly. The caller must then insert
+   *               (a, b) and every edge in spill into the sketches of both endpoints.
+   */
+  bool toggle(node_id_t a, node_id_t b, std::vector<Edge> &spill);
+
+  /*
+   * Access to the exact edges. These functions must not be called
+   * concurrently with toggle().
+   */
+  // append every exact edge, once, to out
+  void get_edges(std::vector<Edge> &out) const;
+  // promote every vertex, used when the sketches already hold every edge
+  void promote_all();
+
+  bool is_promoted(node_id_t v) const { return state[v] == promoted_state; }
+  node_id_t get_num_promoted() const;
+  size_t get_bytes() const {
+    return edges.capacity() * sizeof(node_id_t) + state.capacity() + num_stripes * sizeof(std::mutex);
+  }
+};
@@ -0,0 +1,72 @@
+#pragma once
+#include <types.h>
+
+#include <iostream>
+
+#include "distrib_configuration.h"
+
+/*
+ * The buffering parameters of a GraphDistribUpdate and an estimate of the
+ * memory they require on the leader and on each worker. Without a budget the
+ * plan holds the default parameters. With a budget the largest gutters whose
+ * estimated memory fits the leader's budget are chosen, shrinking the work
+ * queue and cache tree buffers before the gutters.
+ */
+class MemoryPlan {
+ public:
+  // guttering system parameters
+  double batch_factor;       // gutter size as a multiple of a serialized supernode
+  int buffer_exp;            // log2 bytes of each cache tree buffer
+  size_t fanout;             // cache tree fanout
+  size_t num_flushers;       // threads flushing the guttering system
+  size_t num_graph_workers;  // with queue_factor sets the length of the work queue
+  size_t queue_factor;
+  size_t worker_handlers;    // BatchesToDeltasHandlers per worker, 0 for two per core
+  int max_msg_size;          // bytes of the largest batch or delta message
+
+  // estimated leader memory in bytes
+  size_t sketch_bytes;
+  size_t backup_bytes;
+  size_t low_degree_bytes;
+  size_t gutter_bytes;
+  size_t cache_tree_bytes;
+  size_t work_queue_bytes;
+  size_t distributor_bytes;  // WorkDistributor message buffers and scratch supernodes
+  size_t forwarder_bytes;    // message forwarder processes on the main node
+
+  // estimated worker memory in bytes
+  size_t handler_bytes;      // memory of each BatchesToDeltasHandler
+  size_t worker_fixed_bytes; // memory of a worker other than its handlers
+
+  size_t leader_total() const {
+    return sketch_bytes + backup_bytes + low_degree_bytes + gutter_bytes + cache_tree_bytes +
+           work_queue_bytes + distributor_bytes + forwarder_bytes;
+  }
+  size_t worker_total() const { return worker_fixed_bytes + worker_handlers * handler_bytes; }
+
+  /*
+   * Plan the parameters of a GraphDistribUpdate.
+   * Throws std::invalid_argument if the budget cannot hold the sketches and
+   * the smallest supported buffers. Supernodes remain sized for the graph
+   * that is currently constructed, if any.
+   */
+  static MemoryPlan make(node_id_t num_nodes, node_id_t k, int num_inserters,
+                         const DistribConfiguration &conf);
+
+  friend std::ostream &operator<<(std::ostream &out, const MemoryPlan &plan);
+
+ private:
+  MemoryPlan() = default;
+  /*
+   * Plan a graph that is about to be constructed. Supernodes are left sized
+   * for it, as the Graph will configure them, and make() restores that size.
+   */
+  static MemoryPlan make_for_graph(node_id_t num_nodes, node_id_t k, int num_inserters,
+                                   const DistribConfiguration &conf);
+  // plan once Supernodes are configured for num_nodes and k
+  static MemoryPlan make_configured(node_id_t num_nodes, node_id_t k, int num_inserters,
+                                    const DistribConfiguration &conf);
+  friend class GraphDistribUpdate;
+  // fill in the memory estimates for the current parameters
+  void estimate(node_id_t num_nodes, int num_inserters, int num_workers);
+};
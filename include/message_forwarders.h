@@ -20,7 +20,7 @@ class BatchMessageForwarder {
   int id;
   bool running = true;
 
-  char** batch_msg_buffers;
+  char** batch_msg_buffers;  // pooled buffers of the messages in flight to each worker
   MPI_Request* batch_requests;
   int num_batch_sent = 0;
   int num_distrib = 0;
@@ -56,6 +56,7 @@ class DeltaMessageForwarder {
   void cleanup();  // deallocate memory before another call to INIT
 
   void send_delta();
+  void send_telemetry();
   void process_distrib_worker_done();
 
  public:
@@ -0,0 +1,111 @@
+#pragma once
+#include <types.h>
+
+#include <atomic>
+#include <cstring>
+#include <string>
+
+/*
+ * A binary graph stream, in the format written for GraphZeppelin's
+ * BinaryGraphStream, read through a read only memory mapping of the file.
+ * The file begins with the number of nodes (4 bytes) and updates (8 bytes)
+ * followed by 9 byte updates: the UpdateType in one byte then src and dst.
+ *
+ * Each MmapStreamReader claims a large chunk of consecutive updates at a
+ * time, so inserter threads share only one atomic counter. A claimed chunk
+ * is faulted in with a single madvise and the chunk after it is read ahead.
+ * Chunks are released from the process with MADV_DONTNEED once decoded, so
+ * that the mapping does not count towards the resident memory of the leader.
+ *
+ * Like BinaryGraphStream_MT, a query may be registered at an update index.
+ * Readers return BREAKPOINT once every update before the index has been
+ * claimed, and keep doing so until post_query_resume() is called. Readers
+ * also return BREAKPOINT at the end of the stream.
+ */
+class MmapGraphStream {
+ private:
+  static constexpr size_t header_size = sizeof(node_id_t) + sizeof(edge_id_t);
+  static constexpr size_t update_size = sizeof(uint8_t) + 2 * sizeof(node_id_t);
+
+  int fd;
+  char *data;              // the mapped file
+  size_t file_bytes;
+  node_id_t num_nodes;
+  edge_id_t num_edges;
+  size_t chunk_updates;    // updates claimed by a reader at a time
+
+  std::atomic<edge_id_t> next_update{0};  // first update not claimed by a reader
+  std::atomic<edge_id_t> query_index;     // readers stop here, num_edges without a query
+
+  /*
+   * Claim the next chunk of at most chunk_updates updates before the query index.
+   * @return  false if there are no updates left before the query index
+   */
+  bool claim(edge_id_t &first, edge_id_t &last);
+  // advise the kernel about the pages holding updates [first, last), false if madvise fails
+  bool advise(edge_id_t first, edge_id_t last, int advice) const;
+  const char *update_ptr(edge_id_t idx) const { return data + header_size + idx * update_size; }
+
+  friend class MmapStreamReader;
+ public:
+  static constexpr size_t default_chunk_bytes = 4 * 1024 * 1024;
+
+  /*
+   * Map the stream in file_name. Throws std::runtime_error if the file cannot
+   * be mapped or is shorter than its header claims.
+   * @param chunk_bytes  bytes of updates claimed by a reader at a time
+   */
+  MmapGraphStream(const std::string &file_name, size_t chunk_bytes = default_chunk_bytes);
+  ~MmapGraphStream();
+  MmapGraphStream(const MmapGraphStream &) = delete;
+  MmapGraphStream &operator=(const MmapGraphStream &) = delete;
+
+  node_id_t nodes() const { return num_nodes; }
+  edge_id_t edges() const { return num_edges; }
+
+  /*
+   * Stop the readers once the updates before query_idx have been claimed.
+   * Register queries while the readers are stopped or well ahead of them.
+   * @return  false if query_idx is beyond the stream or was already claimed
+   */
+  bool register_query(edge_id_t query_idx);
+  // let the readers continue after a query
+  void post_query_resume() { query_index = num_edges; }
+  // return to the beginning of the stream and clear any registered query
+  void stream_reset();
+};
+
+// Decodes the updates of an MmapGraphStream for one inserter thread
+class MmapStreamReader {
+ private:
+  MmapGraphStream &stream;
+  const char *pos = nullptr;  // next update of the current chunk
+  const char *end = nullptr;
+  edge_id_t chunk_first = 0;
+  edge_id_t chunk_last = 0;
+
+  bool next_chunk(); // release the current chunk and claim another
+ public:
+  MmapStreamReader(MmapGraphStream &stream) : stream(stream) {}
+  ~MmapStreamReader();
+
+  GraphUpdate get_edge() {
+    if (pos == end && !next_chunk()) return {{0, 0}, BREAKPOINT};
+    GraphUpdate upd;
+    upd.type = (UpdateType) *pos;
+    std::memcpy(&upd.edge.src, pos + 1, sizeof(node_id_t));
+    std::memcpy(&upd.edge.dst, pos + 1 + sizeof(node_id_t), sizeof(node_id_t));
+    pos += MmapGraphStream::update_size;
+    return upd;
+  }
+
+  // decode up to max_upds updates into upds, returns 0 at a BREAKPOINT
+  size_t get_edges(GraphUpdate *upds, size_t max_upds) {
+    size_t num_upds = 0;
+    for (; num_upds < max_upds; num_upds++) {
+      upds[num_upds] = get_edge();
+      if (upds[num_upds].type == BREAKPOINT) break;
+    }
+    return num_upds;
+  }
+};
@@ -0,0 +1,64 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <mutex>
+#include <vector>
+
+/*
+ * A process wide pool of message buffers shared by every thread. Buffers are
+ * grouped into size classes, four per power of two, so a buffer sized to the
+ * contents of a message wastes at most a quarter of its capacity. Each thread
+ * keeps a small cache of buffers per size class in front of the shared free
+ * lists so that acquiring and releasing a buffer rarely takes a contended
+ * lock. Released buffers are kept for reuse until trim() is called.
+ */
+class MsgBufferPool {
+ private:
+  static constexpr size_t min_class_log = 12;         // smallest class holds 4KiB
+  static constexpr size_t classes_per_doubling = 4;
+  static constexpr size_t num_classes = 1 + classes_per_doubling * (31 - min_class_log);
+  static constexpr size_t thread_cache_size = 4;      // buffers per class cached by a thread
+  static constexpr size_t header_size = 64;           // keeps the buffers cache line aligned
+
+  struct ThreadCache {
+    std::mutex lock; // held by its thread while in use, and by trim()
+    std::vector<char *> free_bufs[num_classes];
+    ThreadCache();
+    ~ThreadCache();
+  };
+  static ThreadCache &thread_cache();
+
+  std::mutex locks[num_classes];
+  std::vector<char *> free_lists[num_classes];
+  std::mutex caches_lock;
+  std::vector<ThreadCache *> caches; // the cache of every live thread, drained by trim()
+  std::atomic<size_t> bytes_allocated{0};
+  std::atomic<size_t> bytes_in_use{0};
+
+  MsgBufferPool() = default;
+  ~MsgBufferPool();
+  void return_to_pool(size_t size_class, char *block);
+  void free_shared(); // free the buffers of the shared free lists
+ public:
+  static MsgBufferPool &get();
+
+  // the size class of a buffer holding bytes and the capacity of a size class
+  static size_t class_of(size_t bytes);
+  static size_t class_bytes(size_t size_class);
+
+  /*
+   * Get a buffer holding at least bytes bytes. Throws std::invalid_argument if
+   * bytes exceeds the largest size class.
+   */
+  char *acquire(size_t bytes);
+  // return a buffer obtained from acquire(), nullptr is ignored
+  void release(char *buf);
+  // free every released buffer, including those cached by other threads
+  void trim();
+
+  size_t get_bytes_allocated() const { return bytes_allocated; }
+  size_t get_bytes_in_use() const { return bytes_in_use; }
+
+  MsgBufferPool(const MsgBufferPool &) = delete;
+  MsgBufferPool &operator=(const MsgBufferPool &) = delete;
+};
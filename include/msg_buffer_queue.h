@@ -1,5 +1,6 @@
 #pragma once
 
+#include <atomic>
 #include <cassert>
 #include <condition_variable>
 #include <list>
@@ -49,9 +50,13 @@ class MsgBufferQueue {
     return ret;
   }
 
+  // number of elements in the queue, may be stale if other threads are pushing or popping
+  size_t size() { return num_elms.load(std::memory_order_relaxed); }
+
  private:
   QueueElm* head = nullptr;
   QueueElm* tail = nullptr;
+  std::atomic<size_t> num_elms{0};
 
   std::mutex list_mutex;
   std::condition_variable empty_condition;
@@ -87,6 +92,7 @@ void MsgBufferQueue<MsgData>::push(MsgBufferQueue::QueueElm* elm) {
     tail->next = elm;
 
   tail = elm;
+  num_elms.fetch_add(1, std::memory_order_relaxed);
 
   list_mutex.unlock();
 }
@@ -98,6 +104,7 @@ typename MsgBufferQueue<MsgData>::QueueElm* MsgBufferQueue<MsgData>::pop() {
   if (head != nullptr && head->next != nullptr) {
     MsgBufferQueue::QueueElm* ret = head;
     head = head->next;
+    num_elms.fetch_sub(1, std::memory_order_relaxed);
     return ret;
   }
 
@@ -107,6 +114,7 @@ typename MsgBufferQueue<MsgData>::QueueElm* MsgBufferQueue<MsgData>::pop() {
   MsgBufferQueue::QueueElm* ret = head;
   head = head->next;
   if (head == nullptr) tail = nullptr;
+  num_elms.fetch_sub(1, std::memory_order_relaxed);
   lk.unlock();
 
   return ret;
@@ -0,0 +1,36 @@
+#pragma once
+#include <types.h>
+
+#include <string>
+#include <vector>
+
+/*
+ * The NUMA nodes of this machine and the cpus that belong to each, read from
+ * /sys/devices/system/node. Machines without NUMA information are reported
+ * as a single node containing every cpu.
+ */
+class NumaTopology {
+ private:
+  std::vector<std::vector<int>> node_cpus; // cpus of each NUMA node with cpus
+
+ public:
+  NumaTopology();
+
+  size_t get_num_nodes() const { return node_cpus.size(); }
+  const std::vector<int> &get_cpus(size_t node) const { return node_cpus[node]; }
+
+  // the NUMA node owning vertex v when vertices are divided into contiguous ranges
+  size_t node_of_vertex(node_id_t v, node_id_t num_vertices) const {
+    return (size_t)v * get_num_nodes() / num_vertices;
+  }
+  // first vertex of the range owned by a NUMA node
+  node_id_t first_vertex(size_t node, node_id_t num_vertices) const {
+    return ((size_t)node * num_vertices + get_num_nodes() - 1) / get_num_nodes();
+  }
+
+  // restrict the calling thread to the cpus of a NUMA node, returns false on failure
+  bool pin_thread(size_t node) const;
+
+  // parse a cpulist such as "0-17,36-53"
+  static std::vector<int> parse_cpulist(const std::string &cpulist);
+};
@@ -0,0 +1,43 @@
+#pragma once
+#include <cstddef>
+
+class Supernode;
+
+/*
+ * A single contiguous region of memory that hands out fixed size, cache line
+ * aligned slots for scratch supernodes. The region is backed by 2MB huge pages
+ * when the system provides them (explicitly reserved pages first, then
+ * transparent huge pages) to reduce TLB misses when generating sketches.
+ * The region is kept between sessions and only remapped when a session
+ * needs more memory than is currently mapped.
+ */
+class SupernodeArena {
+ private:
+  char *base = nullptr;
+  size_t capacity = 0;   // number of bytes mapped
+  size_t slot_size = 0;  // bytes per slot, a multiple of slot_align
+  size_t num_slots = 0;
+  bool huge_pages = false;
+
+  void release();
+ public:
+  static constexpr size_t huge_page_size = 2 * 1024 * 1024;
+  static constexpr size_t slot_align = 64;
+
+  SupernodeArena() = default;
+  ~SupernodeArena() { release(); }
+  SupernodeArena(const SupernodeArena &) = delete;
+  SupernodeArena &operator=(const SupernodeArena &) = delete;
+
+  /*
+   * Prepare the arena to hold _num_slots slots of at least supernode_size bytes.
+   * Slots returned before this call are invalidated.
+   * Throws std::bad_alloc if the memory cannot be mapped.
+   */
+  void reserve(size_t supernode_size, size_t _num_slots);
+
+  Supernode *get_slot(size_t idx) const { return (Supernode *)(base + idx * slot_size); }
+  size_t get_num_slots() const { return num_slots; }
+  size_t get_capacity() const { return capacity; }
+  bool uses_huge_pages() const { return huge_pages; }
+};
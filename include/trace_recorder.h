@@ -0,0 +1,94 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <types.h>
+
+/*
+ * Records timestamped spans of work on every rank of the cluster and merges
+ * them into a single Chrome trace (viewable in chrome://tracing or Perfetto)
+ * when the cluster shuts down. Tracing is opt in, it is compiled only when
+ * LANDSCAPE_TRACE is defined (cmake -DLANDSCAPE_TRACE=ON).
+ *
+ * Each thread writes its spans into its own fixed size ring buffer, keeping
+ * only the most recent spans, so recording never takes a lock. Timestamps
+ * are moved onto the leader's clock using offsets measured when the
+ * cluster is set up.
+ */
+class TraceRecorder {
+ public:
+  struct Event {
+    const char *name;
+    uint64_t start_ns;
+    uint64_t dur_ns;
+    int64_t arg;
+  };
+
+  static constexpr size_t ring_capacity = 1 << 14; // spans kept per thread
+
+ private:
+  struct Ring {
+    Event events[ring_capacity];
+    std::atomic<uint64_t> num_written{0};
+    int tid;
+  };
+
+  static std::mutex rings_lock; // only taken when a thread records its first span
+  static std::vector<Ring *> rings;
+  static int64_t clock_offset_ns; // add to local timestamps to get the leader's time
+  static int rank;
+  static std::string process_name;
+  static bool active;
+
+  static Ring &thread_ring();
+  // measure the offset of this rank's clock from the leader's, collective
+  static void align_clocks();
+  // this rank's spans as comma separated Chrome trace events
+  static std::string serialize_events();
+
+ public:
+  /*
+   * Begin recording. Collective over MPI_COMM_WORLD, call after MPI is initialized.
+   * @param name   label of this process in the trace
+   */
+  static void init(const std::string &name);
+
+  /*
+   * Gather every rank's spans to the leader, which writes them to trace_file.
+   * Collective over MPI_COMM_WORLD, call before MPI_Finalize.
+   */
+  static void finish(const std::string &trace_file = "landscape_trace.json");
+
+  static void record(const char *name, uint64_t start_ns, uint64_t end_ns, int64_t arg);
+
+  // the first node id of a BATCH or DELTA message, used to link the spans of a message
+  static int64_t first_node(const char *msg, int msg_size) {
+    if (msg == nullptr || msg_size < (int) sizeof(node_id_t)) return -1;
+    node_id_t node;
+    memcpy(&node, msg, sizeof(node));
+    return node;
+  }
+};
+
+// Records a span covering the rest of the enclosing scope
+class TraceSpan {
+ private:
+  const char *name;
+  int64_t arg;
+  uint64_t start_ns;
+ public:
+  TraceSpan(const char *name, int64_t arg = -1);
+  ~TraceSpan();
+};
+
+#ifdef LANDSCAPE_TRACE
+#define TRACE_CONCAT_(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_(a, b)
+#define TRACE_SPAN(name, arg) TraceSpan TRACE_CONCAT(trace_span_, __LINE__)(name, arg)
+#else
+#define TRACE_SPAN(name, arg)
+#endif
@@ -8,6 +8,9 @@
 
 #include <guttering_system.h>
 #include <worker_cluster.h>
+#include "supernode_arena.h"
+#include "numa_topology.h"
+#include "cluster_metrics.h"
 
 // forward declarations
 class GraphDistribUpdate;
@@ -52,8 +55,15 @@ public:
   }
 
   static bool is_shutdown() { return shutdown; }
+  // number of updates the WorkDistributors applied locally instead of sending to the cluster
+  static uint64_t get_proc_locally() { return proc_locally; }
+  // which stage bounded throughput in the last session, computed by stop_workers()
+  static const BottleneckReport &get_bottleneck_report() { return bottleneck_report; }
+  // bytes mapped for the scratch supernodes of every WorkDistributor
+  static size_t get_arena_bytes() { return supernode_arena.get_capacity(); }
   static constexpr size_t local_process_cutoff = 400;
   static constexpr size_t num_helper_threads = 4;
+  static constexpr size_t supernodes_per_distributor = num_helper_threads + 1;
 private:
   /**
    * Create a WorkDistributor object by setting metadata and spinning up a thread.
@@ -85,13 +95,12 @@ private:
   void do_send_work(); // function which runs to send batches
   void do_recv_work(); // function which runs to recieve deltas
   int id;
+  int numa_node;         // NUMA node this WorkDistributor's threads run on, -1 if unpinned
   GraphDistribUpdate *graph;
   GutteringSystem *gts;
 
   std::atomic<uint64_t> num_updates;
   bool thr_paused;       // indicates if this WorkDistributor is paused
-  char* send_buf;
-  char* recv_buf;
   std::thread thr;       // Work Distributor thread that sends batches and does other things
   std::thread delta_thr; // helper thread that recieves deltas
   size_t outstanding_deltas = 0;
@@ -109,9 +118,25 @@ private:
   static int work_distrib_threads;
   static std::atomic<uint64_t> proc_locally;
 
+  // time spent ingesting this session, for the bottleneck report
+  static uint64_t session_start_ns;
+  static uint64_t pause_start_ns;
+  static uint64_t paused_ns;
+  static std::string bottleneck_file;
+  static BottleneckReport bottleneck_report;
+
   // configuration
   static node_id_t supernode_size;
 
+  // scratch supernodes of every WorkDistributor, kept between sessions
+  static SupernodeArena supernode_arena;
+
+  // the leader's NUMA nodes if the threads should be pinned, otherwise nullptr
+  static const NumaTopology *numa;
+  void pin_to_numa_node() const {
+    if (numa_node >= 0) numa->pin_thread(numa_node);
+  }
+
   // list of all WorkDistributors
   static WorkDistributor **workers;
   static std::thread status_thread;
@@ -2,9 +2,14 @@
 #include <supernode.h>
 #include <types.h>
 #include <guttering_system.h>
+#include <mpi.h>
 
 #include <sstream>
 
+#ifndef LANDSCAPE_NUM_BATCHES
+#define LANDSCAPE_NUM_BATCHES 32
+#endif
+
 typedef std::pair<node_id_t, std::vector<node_id_t>> batch_t;
 enum MessageCode {
   INIT,            // Initialize a process
@@ -13,7 +18,8 @@ enum MessageCode {
   QUERY,           // Perform a query across a set of sketches for main
   FLUSH,           // Tell worker to flush all its local buffers
   STOP,            // Tell the process to wait for new init message
-  SHUTDOWN         // Tell the process to shutdown
+  SHUTDOWN,        // Tell the process to shutdown
+  TELEMETRY        // Report of a distributed worker's recent activity for main
 };
 
 class GraphDistribUpdate;
@@ -33,6 +39,13 @@ private:
   static int max_msg_size;
   static bool active;
 
+  // the processes of this leader's cluster: the leader, its forwarders and its workers
+  static MPI_Comm comm;
+  // the leader of every cluster, MPI_COMM_NULL on processes that are not a leader
+  static MPI_Comm leader_comm;
+  static int num_leaders;
+  static int leader_id;
+
   static inline int batch_fwd_to_delta_fwd(int fid) {
     return fid + num_msg_forwarders;
   }
@@ -61,35 +74,68 @@ private:
   static MessageCode recv_message_from(int source, char* msg_addr, int& msg_size);
 
   /*
-   * DistributedWorker: Take a message and parse it into a vector of batches
-   * @param msg_addr   The address of the message
-   * @param msg_size   The size of the message
-   * @param batches    A reference to the vector where we should store the batches
-   */
-  static void parse_batches(char* msg_addr, int msg_size, std::vector<batch_t>& batches);
-
-  /*
-   * DistributedWorker: Serialize a supernode delta to a chunk of memory
-   * @param node_idx   The node id the supernode delta refers to
-   * @param delta      The Supernode delta to serialize
-   * @param serialstr  A serial string to place serialized delta into
+   * Call this function to recieve a message into a MsgBufferPool buffer sized to the message
+   * @param msg_addr   set to the buffer holding the message, nullptr for an empty message.
+   *                   The caller returns the buffer with MsgBufferPool::release()
+   * @param msg_size   pass in the maximum allowed size, function modifies
+                       this variable to contain size of message recieved
+   * @param msg_src    will contain the source process id when returning
+   * @param source     the process to recieve from, by default any process
+   * @return           a message code signifying the type of message recieved
    */
-  static void serialize_delta(const node_id_t node_idx, Supernode &delta, std::ostream &serial_str);
+  static MessageCode recv_pooled_message(char*& msg_addr, int& msg_size, int& msg_src,
+                                         int source = MPI_ANY_SOURCE);
 
   friend class WorkDistributor;       // class that sends out work
   friend class DistributedWorker;     // class that does work
   friend class BatchMessageForwarder; // class that forwards messages from WD to DW
   friend class DeltaMessageForwarder; // class that forwards messages from DW to WD
 public:
+  /*
+   * Divide the MPI processes into num_leaders clusters of consecutive ranks.
+   * Within its cluster's communicator every process has the rank it would have
+   * in a single leader cluster, so a cluster is laid out as described below.
+   * Called by GraphDistribUpdate::setup_cluster() once MPI is initialized.
+   */
+  static void split_leaders(int num_leaders);
+  static MPI_Comm get_comm() { return comm; }
+  static MPI_Comm get_leader_comm() { return leader_comm; }
+  static int get_num_leaders() { return num_leaders; }
+  static int get_leader_id() { return leader_id; }
+
+  /*
+   * Each leader owns the sketches of a contiguous range of node ids. Leader l
+   * owns [leader_first_node(l), leader_first_node(l + 1)).
+   */
+  static node_id_t leader_first_node(int leader, node_id_t n_nodes) {
+    return (uint64_t) n_nodes * leader / num_leaders;
+  }
+  static int leader_of(node_id_t node, node_id_t n_nodes) {
+    return (((uint64_t) node + 1) * num_leaders - 1) / n_nodes;
+  }
+
+  /*
+   * Set the graph parameters used to parse deltas. start_cluster() does this,
+   * call it directly only to use the message functions without a cluster.
+   */
+  static void configure(node_id_t num_nodes, uint64_t seed);
+
   /*
    * WorkDistributor: Starts a worker cluster and spins up WorkDistributor threads
    * @param num_nodes   Number of nodes in the graph
    * @param seed        Random seed utilized by graph
    * @param batch_size  The size, in bytes, of a single batch
+   * @param num_handlers  The number of batch handlers each worker should allocate,
+   *                      0 for the worker's default
    * @return            The number of workers in the cluster
    */
  static int start_cluster(node_id_t num_nodes, uint64_t seed, int batch_size,
-                          double sketches_factor);
+                          double sketches_factor, int num_handlers = 0);
+
+ // the largest message required to send num_batches batches of batch_size
+ static constexpr int msg_size_for(size_t batch_size) {
+   return (2*sizeof(node_id_t) + sizeof(node_id_t) * batch_size) * num_batches + sizeof(int);
+ }
 
  /*
   * WorkDistributor: Tell the cluster that the current GraphDistribUpdate is stopping
@@ -108,20 +154,49 @@ public:
   * a DistributedWorker
   * @param wid         The id of the DistributedWorker to send to
   * @param batches     The data to send to the distributed worker
-  * @param msg_buffer  Memory buffer to use for recieving a message
   */
- static void send_batches(int wid, const std::vector<update_batch>& batches, char* msg_buffer);
+ static void send_batches(int wid, const std::vector<update_batch>& batches);
+
+ // the size of the BATCH message holding the non-empty batches
+ static size_t serialized_batches_size(const std::vector<update_batch>& batches);
+
+ /*
+  * WorkDistributor: Serialize the non-empty batches into a BATCH message
+  * @param batches     The batches to serialize
+  * @param msg_buffer  Buffer of at least serialized_batches_size(batches) bytes
+  * @return            The size of the message
+  */
+ static size_t serialize_batches(const std::vector<update_batch>& batches, char* msg_buffer);
+
+ /*
+  * DistributedWorker: Take a message and parse it into a vector of batches
+  * @param msg_addr   The address of the message
+  * @param msg_size   The size of the message
+  * @param batches    A reference to the vector where we should store the batches
+  */
+ static void parse_batches(char* msg_addr, int msg_size, std::vector<batch_t>& batches);
+
+ /*
+  * DistributedWorker: Serialize a supernode delta to a chunk of memory
+  * @param node_idx   The node id the supernode delta refers to
+  * @param delta      The Supernode delta to serialize
+  * @param serialstr  A serial string to place serialized delta into
+  */
+ static void serialize_delta(const node_id_t node_idx, Supernode &delta, std::ostream &serial_str);
 
  /*
   * WorkDistributor: use this function to wait for the deltas to be returned
   * @param msg_buffer  Message buffer containing the serialized deltas
-  * @param msg_size    The size of the serialized deltas
+  * @param msg_size    The size of the serialized deltas and trailer
   * @param delta       The Supernode delta memory location
   * @param num_deltas  The number of deltas to recieve
   * @param graph       The graph to update with the delta
   */
  static void parse_and_apply_deltas(char* msg_buffer, int msg_size, Supernode* delta,
                                     GraphDistribUpdate* graph);
+ // apply the deltas to supernodes, an array of every node's Supernode
+ static void parse_and_apply_deltas(char* msg_buffer, int msg_size, Supernode* delta,
+                                    Supernode* const* supernodes);
 
  /*
   * DistributedWorker: return a supernode delta to the main node
@@ -140,9 +215,12 @@ public:
 
  static bool is_active() { return active; }
 
- static constexpr size_t num_batches = 32;  // the number of Supernodes updated by each batch_msg
+ // the number of Supernodes updated by each batch_msg
+ static constexpr size_t num_batches = LANDSCAPE_NUM_BATCHES;
+ // DELTA messages end with the nanoseconds the DistributedWorker spent generating the deltas
+ static constexpr size_t delta_trailer_size = sizeof(uint64_t);
 
- // leader process and forwarder processes on the main node
+ // ranks within comm of the leader process and the forwarder processes on its node
  static constexpr int leader_proc = 0;          // main node
  static constexpr int num_msg_forwarders = 10;  // sending/recieving messages for main
  static constexpr int distrib_worker_offset = 2 * num_msg_forwarders + 1;
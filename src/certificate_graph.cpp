@@ -0,0 +1,254 @@
+#include "certificate_graph.h"
+
+#include <algorithm>
+#include <limits>
+#include <numeric>
+
+CertificateGraph::CertificateGraph(const std::vector<std::set<node_id_t>> &adj_list)
+    : num_vertices(adj_list.size()), offsets(adj_list.size() + 1, 0) {
+  // count the degree of each vertex. Each edge is stored once in adj_list.
+  std::vector<size_t> in_degree(num_vertices, 0);
+#pragma omp parallel for schedule(dynamic, 1024)
+  for (node_id_t src = 0; src < num_vertices; src++) {
+    for (node_id_t dst : adj_list[src]) {
+#pragma omp atomic
+      in_degree[dst]++;
+    }
+  }
+  for (node_id_t v = 0; v < num_vertices; v++)
+    offsets[v + 1] = offsets[v] + adj_list[v].size() + in_degree[v];
+
+  targets.resize(offsets[num_vertices]);
+  weights.resize(offsets[num_vertices], 1);
+
+  // each vertex lists the edges from adj_list first followed by the reversed edges
+  std::vector<size_t> reverse_pos(num_vertices);
+  for (node_id_t v = 0; v < num_vertices; v++)
+    reverse_pos[v] = offsets[v] + adj_list[v].size();
+
+#pragma omp parallel for schedule(dynamic, 1024)
+  for (node_id_t src = 0; src < num_vertices; src++) {
+    size_t pos = offsets[src];
+    for (node_id_t dst : adj_list[src]) {
+      targets[pos++] = dst;
+      size_t rev;
+#pragma omp atomic capture
+      rev = reverse_pos[dst]++;
+      targets[rev] = src;
+    }
+  }
+}
+
+// union-find helpers used to record which vertices are contracted together
+static node_id_t find_root(std::vector<node_id_t> &parent, node_id_t v) {
+  while (parent[v] != v) {
+    parent[v] = parent[parent[v]];
+    v = parent[v];
+  }
+  return v;
+}
+
+static void join(std::vector<node_id_t> &parent, node_id_t a, node_id_t b) {
+  node_id_t root_a = find_root(parent, a);
+  node_id_t root_b = find_root(parent, b);
+  if (root_a != root_b) parent[root_b] = root_a;
+}
+
+// give each set of contracted vertices a compact id, returns the number of sets
+static node_id_t compact_labels(std::vector<node_id_t> &parent, std::vector<node_id_t> &labels) {
+  constexpr node_id_t none = std::numeric_limits<node_id_t>::max();
+  node_id_t num = parent.size();
+  labels.assign(num, none);
+  node_id_t new_vertices = 0;
+  for (node_id_t v = 0; v < num; v++) {
+    node_id_t root = find_root(parent, v);
+    if (labels[root] == none) labels[root] = new_vertices++;
+    labels[v] = labels[root];
+  }
+  return new_vertices;
+}
+
+uint64_t CertificateGraph::min_degree() const {
+  uint64_t min_deg = std::numeric_limits<uint64_t>::max();
+#pragma omp parallel for reduction(min:min_deg)
+  for (node_id_t v = 0; v < num_vertices; v++) {
+    uint64_t deg = 0;
+    for (size_t e = offsets[v]; e < offsets[v + 1]; e++)
+      deg += weights[e];
+    min_deg = std::min(min_deg, deg);
+  }
+  return min_deg;
+}
+
+node_id_t CertificateGraph::padberg_rinaldi(uint64_t lambda, std::vector<node_id_t> &labels) const {
+  std::vector<uint64_t> degree(num_vertices, 0);
+#pragma omp parallel for
+  for (node_id_t v = 0; v < num_vertices; v++)
+    for (size_t e = offsets[v]; e < offsets[v + 1]; e++)
+      degree[v] += weights[e];
+
+  std::vector<node_id_t> parent(num_vertices);
+  std::iota(parent.begin(), parent.end(), 0);
+  std::vector<bool> matched(num_vertices, false);
+  for (node_id_t u = 0; u < num_vertices; u++) {
+    for (size_t e = offsets[u]; e < offsets[u + 1]; e++) {
+      node_id_t v = targets[e];
+      if (v < u) continue; // consider each edge once
+
+      // no cut smaller than lambda separates u and v
+      if (weights[e] >= lambda) {
+        join(parent, u, v);
+        continue;
+      }
+
+      // Moving u (or v) across a cut separating them does not increase its
+      // weight. Contractions by this test must not share an endpoint.
+      if (!matched[u] && !matched[v] && 2 * weights[e] >= std::min(degree[u], degree[v])) {
+        matched[u] = matched[v] = true;
+        join(parent, u, v);
+      }
+    }
+  }
+  return compact_labels(parent, labels);
+}
+
+node_id_t CertificateGraph::capforest(uint64_t lambda, std::vector<node_id_t> &labels) const {
+  constexpr node_id_t none = std::numeric_limits<node_id_t>::max();
+
+  // union-find recording which vertices should be contracted together
+  std::vector<node_id_t> parent(num_vertices);
+  std::iota(parent.begin(), parent.end(), 0);
+
+  // Bucket priority queue over the vertices keyed by min(r(v), lambda).
+  // Bounding the keys by lambda does not change which edges are contracted
+  // and keeps the number of buckets small since lambda < 2k for a certificate.
+  std::vector<node_id_t> bucket_head(lambda + 1, none);
+  std::vector<node_id_t> next(num_vertices);
+  std::vector<node_id_t> prev(num_vertices);
+  auto bucket_insert = [&](node_id_t v, uint64_t key) {
+    prev[v] = none;
+    next[v] = bucket_head[key];
+    if (next[v] != none) prev[next[v]] = v;
+    bucket_head[key] = v;
+  };
+  auto bucket_remove = [&](node_id_t v, uint64_t key) {
+    if (prev[v] != none) next[prev[v]] = next[v];
+    else bucket_head[key] = next[v];
+    if (next[v] != none) prev[next[v]] = prev[v];
+  };
+
+  std::vector<uint64_t> r(num_vertices, 0); // weight of edges from scanned vertices
+  std::vector<bool> scanned(num_vertices, false);
+  for (node_id_t v = num_vertices; v > 0; v--)
+    bucket_insert(v - 1, 0);
+
+  uint64_t max_key = 0;
+  for (node_id_t num_scanned = 0; num_scanned < num_vertices; num_scanned++) {
+    while (bucket_head[max_key] == none) max_key--;
+    node_id_t x = bucket_head[max_key];
+    bucket_remove(x, max_key);
+    scanned[x] = true;
+
+    for (size_t e = offsets[x]; e < offsets[x + 1]; e++) {
+      node_id_t y = targets[e];
+      if (scanned[y]) continue;
+
+      uint64_t old_key = std::min(r[y], lambda);
+      // r[y] is a lower bound on the connectivity of x and y
+      if (r[y] < lambda && r[y] + weights[e] >= lambda) join(parent, x, y);
+      r[y] += weights[e];
+
+      uint64_t new_key = std::min(r[y], lambda);
+      if (new_key != old_key) {
+        bucket_remove(y, old_key);
+        bucket_insert(y, new_key);
+        max_key = std::max(max_key, new_key);
+      }
+    }
+  }
+
+  return compact_labels(parent, labels);
+}
+
+CertificateGraph CertificateGraph::contract(const std::vector<node_id_t> &labels,
+                                            node_id_t new_vertices) const {
+  // group the vertices by the contracted vertex they belong to
+  std::vector<size_t> group_offsets(new_vertices + 1, 0);
+  for (node_id_t v = 0; v < num_vertices; v++)
+    group_offsets[labels[v] + 1]++;
+  for (node_id_t u = 0; u < new_vertices; u++)
+    group_offsets[u + 1] += group_offsets[u];
+  std::vector<node_id_t> members(num_vertices);
+  std::vector<size_t> cursor(group_offsets.begin(), group_offsets.end() - 1);
+  for (node_id_t v = 0; v < num_vertices; v++)
+    members[cursor[labels[v]]++] = v;
+
+  // gather the edges of each contracted vertex, merging parallel edges
+  // and dropping the edges that became self loops
+  std::vector<std::vector<std::pair<node_id_t, uint64_t>>> new_adj(new_vertices);
+#pragma omp parallel for schedule(dynamic, 64)
+  for (node_id_t u = 0; u < new_vertices; u++) {
+    auto &adj = new_adj[u];
+    for (size_t i = group_offsets[u]; i < group_offsets[u + 1]; i++) {
+      node_id_t v = members[i];
+      for (size_t e = offsets[v]; e < offsets[v + 1]; e++) {
+        node_id_t target = labels[targets[e]];
+        if (target != u) adj.push_back({target, weights[e]});
+      }
+    }
+    std::sort(adj.begin(), adj.end());
+
+    size_t merged = 0;
+    for (size_t i = 0; i < adj.size(); i++) {
+      if (merged > 0 && adj[merged - 1].first == adj[i].first)
+        adj[merged - 1].second += adj[i].second;
+      else
+        adj[merged++] = adj[i];
+    }
+    adj.resize(merged);
+  }
+
+  CertificateGraph ret;
+  ret.num_vertices = new_vertices;
+  ret.offsets.assign(new_vertices + 1, 0);
+  for (node_id_t u = 0; u < new_vertices; u++)
+    ret.offsets[u + 1] = ret.offsets[u] + new_adj[u].size();
+  ret.targets.resize(ret.offsets[new_vertices]);
+  ret.weights.resize(ret.offsets[new_vertices]);
+
+#pragma omp parallel for schedule(dynamic, 64)
+  for (node_id_t u = 0; u < new_vertices; u++) {
+    size_t pos = ret.offsets[u];
+    for (auto &edge : new_adj[u]) {
+      ret.targets[pos] = edge.first;
+      ret.weights[pos++] = edge.second;
+    }
+  }
+  return ret;
+}
+
+uint64_t CertificateGraph::min_cut() const {
+  if (num_vertices < 2) return 0;
+
+  // the minimum degree is a cut of the graph and therefore an upper bound
+  uint64_t lambda = min_degree();
+  CertificateGraph contracted;
+  const CertificateGraph *cur = this;
+  std::vector<node_id_t> labels;
+  while (lambda > 0 && cur->num_vertices > 2) {
+    // cheap local contractions first, these quickly shrink sparse certificates
+    node_id_t new_vertices = cur->padberg_rinaldi(lambda, labels);
+    if (new_vertices == cur->num_vertices)
+      new_vertices = cur->capforest(lambda, labels);
+
+    // every pair of vertices is at least lambda connected so lambda is the min cut
+    if (new_vertices < 2) break;
+
+    contracted = cur->contract(labels, new_vertices);
+    cur = &contracted;
+
+    // the degree of a contracted vertex is a cut in the original graph
+    lambda = std::min(lambda, cur->min_degree());
+  }
+  return lambda;
+}
@@ -0,0 +1,393 @@
+#include "cluster_metrics.h"
+
+#include <algorithm>
+#include <iomanip>
+
+LatencyHistogram ClusterMetrics::stages[NUM_STAGES];
+ClusterMetrics::MessageCounters ClusterMetrics::sent[max_message_codes];
+ClusterMetrics::MessageCounters ClusterMetrics::recieved[max_message_codes];
+std::mutex ClusterMetrics::telemetry_lock;
+std::map<int, ClusterMetrics::WorkerRecord> ClusterMetrics::telemetry;
+uint64_t ClusterMetrics::session_start_ns = ClusterMetrics::now_ns();
+
+// Prometheus bucket boundaries are the powers of two from 1us to 64s
+static constexpr int first_export_exp = 10;
+static constexpr int last_export_exp = 36;
+
+size_t LatencyHistogram::bucket_of(uint64_t ns) {
+  if (ns < sub_buckets) return ns;
+  int exp = 63 - __builtin_clzll(ns); // 2^exp <= ns < 2^(exp+1)
+  uint64_t sub = (ns >> (exp - sub_bucket_bits)) - sub_buckets;
+  return sub_buckets * (exp - sub_bucket_bits + 1) + sub;
+}
+
+uint64_t LatencyHistogram::bucket_upper(size_t bucket) {
+  if (bucket < sub_buckets) return bucket;
+  int shift = bucket / sub_buckets - 1;
+  uint64_t lower = (sub_buckets + bucket % sub_buckets) << shift;
+  return lower + ((uint64_t(1) << shift) - 1);
+}
+
+void LatencyHistogram::record(uint64_t ns) {
+  buckets[bucket_of(ns)].fetch_add(1, std::memory_order_relaxed);
+  count.fetch_add(1, std::memory_order_relaxed);
+  sum.fetch_add(ns, std::memory_order_relaxed);
+  uint64_t cur_max = max.load(std::memory_order_relaxed);
+  while (ns > cur_max && !max.compare_exchange_weak(cur_max, ns, std::memory_order_relaxed)) {}
+}
+
+void LatencyHistogram::reset() {
+  for (auto &bucket : buckets) bucket = 0;
+  count = 0;
+  sum = 0;
+  max = 0;
+}
+
+uint64_t LatencyHistogram::percentile(double q) const {
+  uint64_t total = count;
+  if (total == 0) return 0;
+  uint64_t rank = std::max<uint64_t>(1, q * total + 0.5);
+  uint64_t seen = 0;
+  for (size_t b = 0; b < num_buckets; b++) {
+    seen += buckets[b].load(std::memory_order_relaxed);
+    if (seen >= rank) return std::min(bucket_upper(b), get_max());
+  }
+  return get_max();
+}
+
+uint64_t LatencyHistogram::count_below(uint64_t ns) const {
+  uint64_t below = 0;
+  size_t last = ns == 0 ? 0 : bucket_of(ns);
+  for (size_t b = 0; b < last; b++)
+    below += buckets[b].load(std::memory_order_relaxed);
+  return below;
+}
+
+void ClusterMetrics::count_sent(MessageCode code, size_t bytes) {
+  if (code < 0 || code >= max_message_codes) return;
+  sent[code].messages.fetch_add(1, std::memory_order_relaxed);
+  sent[code].bytes.fetch_add(bytes, std::memory_order_relaxed);
+}
+
+void ClusterMetrics::count_recieved(MessageCode code, size_t bytes) {
+  if (code < 0 || code >= max_message_codes) return;
+  recieved[code].messages.fetch_add(1, std::memory_order_relaxed);
+  recieved[code].bytes.fetch_add(bytes, std::memory_order_relaxed);
+}
+
+void ClusterMetrics::reset() {
+  for (auto &stage : stages) stage.reset();
+  for (int c = 0; c < max_message_codes; c++) {
+    sent[c].messages = 0;
+    sent[c].bytes = 0;
+    recieved[c].messages = 0;
+    recieved[c].bytes = 0;
+  }
+  std::lock_guard<std::mutex> lk(telemetry_lock);
+  telemetry.clear();
+  session_start_ns = now_ns();
+}
+
+void ClusterMetrics::record_telemetry(const WorkerTelemetry &report) {
+  uint64_t now = now_ns();
+  std::lock_guard<std::mutex> lk(telemetry_lock);
+  auto it = telemetry.find(report.worker_id);
+  if (it == telemetry.end()) {
+    it = telemetry.emplace(report.worker_id, WorkerRecord()).first;
+    it->second.arrival_ns = session_start_ns;
+  }
+  WorkerRecord &record = it->second;
+
+  // a report's utilization covers the time since the worker's previous report
+  uint64_t covered = now - record.arrival_ns;
+  record.busy_ns += report.utilization * covered;
+  record.covered_ns += covered;
+  if (report.num_handlers > 0) {
+    record.handler_occupancy += 1 - (double) report.idle_handlers / report.num_handlers;
+    record.delta_occupancy += (double) report.pending_deltas / report.num_handlers;
+  }
+  record.num_reports++;
+  record.latest = report;
+  record.arrival_ns = now;
+}
+
+std::vector<WorkerTelemetry> ClusterMetrics::get_telemetry() {
+  std::lock_guard<std::mutex> lk(telemetry_lock);
+  std::vector<WorkerTelemetry> reports;
+  for (auto &entry : telemetry) reports.push_back(entry.second.latest);
+  return reports;
+}
+
+std::vector<int> ClusterMetrics::get_stragglers() {
+  std::vector<WorkerTelemetry> reports = get_telemetry();
+  std::vector<int> stragglers;
+  if (reports.size() < 3) return stragglers; // too few workers to call any of them slow
+
+  std::vector<uint64_t> p50s;
+  for (auto &report : reports) p50s.push_back(report.delta_gen_p50_ns);
+  std::nth_element(p50s.begin(), p50s.begin() + p50s.size() / 2, p50s.end());
+  uint64_t median = p50s[p50s.size() / 2];
+  for (auto &report : reports) {
+    if (report.delta_gen_p50_ns > 2 * median) stragglers.push_back(report.worker_id);
+  }
+  return stragglers;
+}
+
+BottleneckReport ClusterMetrics::bottleneck_report(double active_seconds, int num_distributors) {
+  BottleneckReport report;
+  report.seconds = active_seconds;
+  // total time of the WorkDistributor threads that recorded each stage
+  double thread_ns = std::max(1.0, active_seconds * 1e9 * num_distributors);
+  auto fraction = [&](MetricStage stage) {
+    return std::min(1.0, stages[stage].get_sum() / thread_ns);
+  };
+
+  // time averages over every worker that reported during the session
+  double compute_busy = -1, handler_occupancy = -1, delta_occupancy = -1;
+  {
+    std::lock_guard<std::mutex> lk(telemetry_lock);
+    double busy_ns = 0, covered_ns = 0, handlers = 0, deltas = 0, num_reports = 0;
+    for (auto &entry : telemetry) {
+      busy_ns += entry.second.busy_ns;
+      covered_ns += entry.second.covered_ns;
+      handlers += entry.second.handler_occupancy;
+      deltas += entry.second.delta_occupancy;
+      num_reports += entry.second.num_reports;
+    }
+    if (covered_ns > 0) compute_busy = busy_ns / covered_ns;
+    if (num_reports > 0) {
+      handler_occupancy = handlers / num_reports;
+      delta_occupancy = deltas / num_reports;
+    }
+  }
+
+  // The send thread of a WorkDistributor waits on the guttering system, then
+  // serializes and sends a message. Its recv thread waits for and applies deltas.
+  double send_idle = fraction(GUTTER_WAIT);
+  double compute_idle = compute_busy < 0 ? -1 : 1 - compute_busy;
+  // The guttering system is busy when the send threads wait on it.
+  report.stages = {
+    {"guttering",        send_idle,             -1,                   -1},
+    {"leader_serialize", fraction(SERIALIZE),   send_idle,            -1},
+    {"forwarder_send",   fraction(SEND),        send_idle,            -1},
+    {"worker_compute",   compute_busy,          compute_idle,         handler_occupancy},
+    {"delta_return",     -1,                    -1,                   delta_occupancy},
+    {"leader_apply",     fraction(DELTA_APPLY), fraction(DELTA_RECV), -1},
+  };
+
+  double max_load = 0;
+  for (size_t s = 0; s < report.stages.size(); s++) {
+    if (report.stages[s].load() > max_load) {
+      max_load = report.stages[s].load();
+      report.bottleneck = s;
+    }
+  }
+  return report;
+}
+
+const char *ClusterMetrics::stage_name(MetricStage stage) {
+  switch (stage) {
+    case GUTTER_WAIT:    return "gutter_wait";
+    case SERIALIZE:      return "serialize";
+    case SEND:           return "send";
+    case REMOTE_COMPUTE: return "remote_compute";
+    case DELTA_RECV:     return "delta_recv";
+    case DELTA_APPLY:    return "delta_apply";
+    default:             return "unknown";
+  }
+}
+
+const char *ClusterMetrics::message_name(MessageCode code) {
+  switch (code) {
+    case INIT:      return "INIT";
+    case BATCH:     return "BATCH";
+    case DELTA:     return "DELTA";
+    case QUERY:     return "QUERY";
+    case FLUSH:     return "FLUSH";
+    case STOP:      return "STOP";
+    case SHUTDOWN:  return "SHUTDOWN";
+    case TELEMETRY: return "TELEMETRY";
+    default:        return "UNKNOWN";
+  }
+}
+
+void ClusterMetrics::write_prometheus(std::ostream &out) {
+  out << "# HELP landscape_stage_latency_seconds Latency of each stage of the update path\n";
+  out << "# TYPE landscape_stage_latency_seconds histogram\n";
+  for (int s = 0; s < NUM_STAGES; s++) {
+    const LatencyHistogram &hist = stages[s];
+    const char *name = stage_name((MetricStage) s);
+    for (int e = first_export_exp; e <= last_export_exp; e++) {
+      out << "landscape_stage_latency_seconds_bucket{stage=\"" << name << "\",le=\""
+          << (uint64_t(1) << e) / 1e9 << "\"} " << hist.count_below(uint64_t(1) << e) << "\n";
+    }
+    out << "landscape_stage_latency_seconds_bucket{stage=\"" << name << "\",le=\"+Inf\"} "
+        << hist.get_count() << "\n";
+    out << "landscape_stage_latency_seconds_sum{stage=\"" << name << "\"} "
+        << hist.get_sum() / 1e9 << "\n";
+    out << "landscape_stage_latency_seconds_count{stage=\"" << name << "\"} "
+        << hist.get_count() << "\n";
+  }
+
+  out << "# HELP landscape_stage_latency_quantile_seconds Latency quantiles of each stage\n";
+  out << "# TYPE landscape_stage_latency_quantile_seconds gauge\n";
+  for (int s = 0; s < NUM_STAGES; s++) {
+    const LatencyHistogram &hist = stages[s];
+    const char *name = stage_name((MetricStage) s);
+    for (double q : {0.5, 0.9, 0.99}) {
+      out << "landscape_stage_latency_quantile_seconds{stage=\"" << name << "\",quantile=\""
+          << q << "\"} " << hist.percentile(q) / 1e9 << "\n";
+    }
+    out << "landscape_stage_latency_quantile_seconds{stage=\"" << name << "\",quantile=\"1\"} "
+        << hist.get_max() / 1e9 << "\n";
+  }
+
+  out << "# HELP landscape_messages_total Messages sent and recieved by the leader\n";
+  out << "# TYPE landscape_messages_total counter\n";
+  for (int c = 0; c < max_message_codes; c++) {
+    const char *name = message_name((MessageCode) c);
+    if (sent[c].messages > 0)
+      out << "landscape_messages_total{type=\"" << name << "\",direction=\"out\"} "
+          << sent[c].messages << "\n";
+    if (recieved[c].messages > 0)
+      out << "landscape_messages_total{type=\"" << name << "\",direction=\"in\"} "
+          << recieved[c].messages << "\n";
+  }
+
+  out << "# HELP landscape_message_bytes_total Message bytes sent and recieved by the leader\n";
+  out << "# TYPE landscape_message_bytes_total counter\n";
+  for (int c = 0; c < max_message_codes; c++) {
+    const char *name = message_name((MessageCode) c);
+    if (sent[c].messages > 0)
+      out << "landscape_message_bytes_total{type=\"" << name << "\",direction=\"out\"} "
+          << sent[c].bytes << "\n";
+    if (recieved[c].messages > 0)
+      out << "landscape_message_bytes_total{type=\"" << name << "\",direction=\"in\"} "
+          << recieved[c].bytes << "\n";
+  }
+
+  std::vector<WorkerTelemetry> reports;
+  std::vector<uint64_t> ages;
+  {
+    std::lock_guard<std::mutex> lk(telemetry_lock);
+    for (auto &entry : telemetry) {
+      reports.push_back(entry.second.latest);
+      ages.push_back(now_ns() - entry.second.arrival_ns);
+    }
+  }
+  if (reports.empty()) return;
+
+  out << "# HELP landscape_worker_report_age_seconds Time since the worker's last TELEMETRY report\n";
+  out << "# TYPE landscape_worker_report_age_seconds gauge\n";
+  for (size_t w = 0; w < reports.size(); w++)
+    out << "landscape_worker_report_age_seconds{worker=\"" << reports[w].worker_id << "\"} "
+        << ages[w] / 1e9 << "\n";
+  out << "# HELP landscape_worker_utilization Fraction of helper thread time spent generating deltas\n";
+  out << "# TYPE landscape_worker_utilization gauge\n";
+  for (auto &report : reports)
+    out << "landscape_worker_utilization{worker=\"" << report.worker_id << "\"} "
+        << report.utilization << "\n";
+  out << "# HELP landscape_worker_updates_total Updates processed by the worker\n";
+  out << "# TYPE landscape_worker_updates_total counter\n";
+  for (auto &report : reports)
+    out << "landscape_worker_updates_total{worker=\"" << report.worker_id << "\"} "
+        << report.num_updates << "\n";
+  out << "# HELP landscape_worker_batch_messages_total BATCH messages processed by the worker\n";
+  out << "# TYPE landscape_worker_batch_messages_total counter\n";
+  for (auto &report : reports)
+    out << "landscape_worker_batch_messages_total{worker=\"" << report.worker_id << "\"} "
+        << report.batch_msgs << "\n";
+  out << "# HELP landscape_worker_queue_depth Handlers of the worker in each queue\n";
+  out << "# TYPE landscape_worker_queue_depth gauge\n";
+  for (auto &report : reports) {
+    out << "landscape_worker_queue_depth{worker=\"" << report.worker_id << "\",queue=\"recv\"} "
+        << report.idle_handlers << "\n";
+    out << "landscape_worker_queue_depth{worker=\"" << report.worker_id << "\",queue=\"send\"} "
+        << report.pending_deltas << "\n";
+  }
+  out << "# HELP landscape_worker_delta_gen_seconds Time to generate the deltas of a message\n";
+  out << "# TYPE landscape_worker_delta_gen_seconds gauge\n";
+  for (auto &report : reports) {
+    out << "landscape_worker_delta_gen_seconds{worker=\"" << report.worker_id
+        << "\",quantile=\"0.5\"} " << report.delta_gen_p50_ns / 1e9 << "\n";
+    out << "landscape_worker_delta_gen_seconds{worker=\"" << report.worker_id
+        << "\",quantile=\"0.99\"} " << report.delta_gen_p99_ns / 1e9 << "\n";
+    out << "landscape_worker_delta_gen_seconds{worker=\"" << report.worker_id
+        << "\",quantile=\"1\"} " << report.delta_gen_max_ns / 1e9 << "\n";
+  }
+  out << "# HELP landscape_worker_memory_bytes Memory of the worker's supernodes and message buffers\n";
+  out << "# TYPE landscape_worker_memory_bytes gauge\n";
+  for (auto &report : reports)
+    out << "landscape_worker_memory_bytes{worker=\"" << report.worker_id << "\"} "
+        << report.memory_bytes << "\n";
+  out << "# HELP landscape_worker_memory_component_bytes Memory of each component of the worker\n";
+  out << "# TYPE landscape_worker_memory_component_bytes gauge\n";
+  for (auto &report : reports) {
+    for (auto &component : report.memory.report().components) {
+      out << "landscape_worker_memory_component_bytes{worker=\"" << report.worker_id
+          << "\",component=\"" << component.name << "\"} " << component.bytes << "\n";
+    }
+  }
+}
+
+void ClusterMetrics::write_leader_memory(std::ostream &out, const MemoryReport &leader_memory) {
+  out << "# HELP landscape_leader_memory_bytes Memory of each component of the leader\n";
+  out << "# TYPE landscape_leader_memory_bytes gauge\n";
+  for (auto &component : leader_memory.components) {
+    out << "landscape_leader_memory_bytes{component=\"" << component.name << "\",estimated=\""
+        << (component.estimated ? "true" : "false") << "\"} " << component.bytes << "\n";
+  }
+}
+
+void BottleneckReport::write_json(std::ostream &out) const {
+  auto value = [&](double v) -> std::ostream & {
+    if (v < 0) return out << "null";
+    return out << v;
+  };
+  out << "{\"seconds\": " << seconds << ", \"bottleneck\": ";
+  if (bottleneck < 0) out << "null";
+  else out << "\"" << stages[bottleneck].name << "\"";
+  out << ", \"stages\": [";
+  for (size_t s = 0; s < stages.size(); s++) {
+    if (s > 0) out << ", ";
+    out << "{\"name\": \"" << stages[s].name << "\", \"busy\": ";
+    value(stages[s].busy) << ", \"idle\": ";
+    value(stages[s].idle) << ", \"occupancy\": ";
+    value(stages[s].occupancy) << "}";
+  }
+  out << "]}" << std::endl;
+}
+
+std::ostream &operator<<(std::ostream &out, const BottleneckReport &report) {
+  auto value = [&](double v) -> std::ostream & {
+    if (v < 0) return out << std::setw(10) << "-";
+    return out << std::setw(10) << std::fixed << std::setprecision(3) << v;
+  };
+  out << "Bottleneck Report (" << report.seconds << " seconds of ingestion):" << std::endl;
+  out << std::left << std::setw(18) << " stage" << std::right << std::setw(10) << "busy"
+      << std::setw(10) << "idle" << std::setw(10) << "occupancy" << std::endl;
+  for (auto &stage : report.stages) {
+    out << " " << std::left << std::setw(17) << stage.name << std::right;
+    value(stage.busy);
+    value(stage.idle);
+    value(stage.occupancy) << std::endl;
+  }
+  out << std::defaultfloat << std::setprecision(6);
+  out << " Throughput bounded by: ";
+  if (report.bottleneck < 0) out << "UNKNOWN (nothing was measured)";
+  else out << report.stages[report.bottleneck].name;
+  return out;
+}
+
+std::ostream &operator<<(std::ostream &out, const MemoryReport &report) {
+  out << std::fixed << std::setprecision(3);
+  for (auto &component : report.components) {
+    out << " " << std::left << std::setw(24) << component.name << std::right << std::setw(12)
+        << component.bytes / 1e9 << " GB" << (component.estimated ? " (planned)" : "")
+        << std::endl;
+  }
+  out << " " << std::left << std::setw(24) << "total" << std::right << std::setw(12)
+      << report.total() / 1e9 << " GB";
+  out << std::defaultfloat << std::setprecision(6);
+  return out;
+}
@@ -0,0 +1,60 @@
+#include "distrib_configuration.h"
+
+DistribConfiguration &DistribConfiguration::backup_in_mem(bool backup_in_mem) {
+  _backup_in_mem = backup_in_mem;
+  return *this;
+}
+
+DistribConfiguration &DistribConfiguration::backup_dir(std::string backup_dir) {
+  if (backup_dir.empty()) backup_dir = ".";
+  if (backup_dir.back() != '/') backup_dir += '/';
+  _backup_dir = backup_dir;
+  return *this;
+}
+
+DistribConfiguration &DistribConfiguration::low_degree_threshold(size_t threshold) {
+  _low_degree_threshold = threshold;
+  return *this;
+}
+
+DistribConfiguration &DistribConfiguration::numa_aware(bool numa_aware) {
+  _numa_aware = numa_aware;
+  return *this;
+}
+
+DistribConfiguration &DistribConfiguration::metrics_file(std::string metrics_file) {
+  _metrics_file = metrics_file;
+  return *this;
+}
+
+DistribConfiguration &DistribConfiguration::bottleneck_file(std::string bottleneck_file) {
+  _bottleneck_file = bottleneck_file;
+  return *this;
+}
+
+DistribConfiguration &DistribConfiguration::memory_budget(ResourceBudget budget) {
+  _use_budget = true;
+  _budget = budget;
+  return *this;
+}
+
+std::ostream &operator<<(std::ostream &out, const DistribConfiguration &conf) {
+  out << "Landscape Configuration:" << std::endl;
+  out << " Query backup location = " << (conf._backup_in_mem ? "IN MEMORY" : conf._backup_dir)
+      << std::endl;
+  out << " Low degree threshold  = ";
+  if (conf._low_degree_threshold == 0) out << "DISABLED";
+  else out << conf._low_degree_threshold;
+  out << std::endl;
+  out << " NUMA aware            = " << (conf._numa_aware ? "ON" : "OFF") << std::endl;
+  out << " Metrics file          = " << (conf._metrics_file.empty() ? "DISABLED" : conf._metrics_file)
+      << std::endl;
+  out << " Bottleneck file       = "
+      << (conf._bottleneck_file.empty() ? "DISABLED" : conf._bottleneck_file) << std::endl;
+  out << " Memory budget         = ";
+  if (!conf._use_budget) out << "DEFAULT PARAMETERS";
+  else out << "leader " << conf._budget.leader_bytes / 1e9 << " GB / "
+           << conf._budget.leader_cores << " cores, worker " << conf._budget.worker_bytes / 1e9
+           << " GB / " << conf._budget.worker_cores << " cores";
+  return out;
+}
@@ -1,29 +1,25 @@
 #include "distributed_worker.h"
 #include "worker_cluster.h"
 #include "graph_distrib_update.h"
+#include "msg_buffer_pool.h"
+#include "cluster_metrics.h"
+#include "trace_recorder.h"
 
 #include <mpi.h>
+#include <algorithm>
 #include <iostream>
 #include <thread>
 
 DistributedWorker::DistributedWorker(int _id) : id(_id) {
-  init_worker();
-  running = true;
-
-  // Create recieve message queue (send message queue starts empty)
   helper_threads = std::thread::hardware_concurrency();
-  for (size_t i = 0; i < 2 * helper_threads; i++) {
-    BatchesToDeltasHandler msg_handler(max_msg_size, WorkerCluster::num_batches);
-    MsgBufferQueue<BatchesToDeltasHandler>::QueueElm* q_elm =
-        new MsgBufferQueue<BatchesToDeltasHandler>::QueueElm(msg_handler);
-    recv_msg_queue.emplace_back(q_elm);
-  }
+  init_worker();
+  if (running) prepare_handlers();
 
   // std::cout << "Successfully started distributed worker " << id << "!" << std::endl;
   run();
 }
 DistributedWorker::~DistributedWorker() {
-  if (recv_msg_queue.size() != 2 * helper_threads) {
+  if (recv_msg_queue.size() != num_allocated_handlers) {
     std::cerr << "WARNING: recv queue not full when deleting DeltaNode -- memory leak" << std::endl;
   }
   for (auto handler : recv_msg_queue) {
@@ -33,6 +29,10 @@ DistributedWorker::~DistributedWorker() {
 
 void DistributedWorker::run() {
   num_updates = 0;
+  num_batch_msgs = 0;
+  busy_ns = 0;
+  last_report_busy_ns = 0;
+  last_report_ns = ClusterMetrics::now_ns();
 #pragma omp parallel num_threads(helper_threads + 1)
 #pragma omp single
   {
@@ -48,20 +48,29 @@ void DistributedWorker::run() {
 
       // Extract stuff from the data_handler
       // std::cout << "DistributedWorker: " << id << " waiting for message ..." << std::endl;
-      char* recv_buffer = q_elm->data.batches_buffer;
-      MessageCode code = WorkerCluster::recv_message(recv_buffer, msg_size, q_elm->data.msg_src);
+      MessageCode code = WorkerCluster::recv_pooled_message(q_elm->data.batches_buffer, msg_size,
+                                                            q_elm->data.msg_src);
 
       if (code == BATCH) {
         // std::cout << "DistributedWorker: " << id << " batch message" << std::endl;
-#pragma omp task firstprivate(q_elm, msg_size) default(none) shared(num_updates)
+#pragma omp task firstprivate(q_elm, msg_size) default(none) \
+    shared(num_updates, num_batch_msgs, busy_ns, delta_gen_time)
         {
-          char* recv_buffer = q_elm->data.batches_buffer;
-          std::vector<delta_t>& deltas = q_elm->data.deltas;
-          omemstream& stream = q_elm->data.serial_stream;
+          uint64_t start = ClusterMetrics::now_ns();
+          auto& data = q_elm->data;
+          std::vector<delta_t>& deltas = data.deltas;
+          TRACE_SPAN("generate_deltas", TraceRecorder::first_node(data.batches_buffer, msg_size));
 
           // deserialize data -- get id and vector of batches
           std::vector<batch_t> batches;
-          WorkerCluster::parse_batches(recv_buffer, msg_size, batches);
+          WorkerCluster::parse_batches(data.batches_buffer, msg_size, batches);
+          MsgBufferPool::get().release(std::exchange(data.batches_buffer, nullptr));
+
+          // the serialized deltas are no larger than the full supernodes
+          size_t delta_bytes = batches.size() * (sizeof(node_id_t) + Supernode::get_serialized_size())
+                               + WorkerCluster::delta_trailer_size;
+          data.delta_msg = MsgBufferPool::get().acquire(delta_bytes);
+          omemstream stream(data.delta_msg, delta_bytes);
 
           // create deltas 
           for (size_t i = 0; i < batches.size(); i++) {
@@ -74,11 +83,25 @@ void DistributedWorker::run() {
                                        delta.supernode);
             WorkerCluster::serialize_delta(delta.node_idx, *delta.supernode, stream);
           }
+          uint64_t compute_ns = ClusterMetrics::now_ns() - start;
+          stream.write((const char *) &compute_ns, sizeof(compute_ns));
+          data.delta_msg_size = stream.tellp();
+          delta_gen_time.record(compute_ns);
+          busy_ns += compute_ns;
+          ++num_batch_msgs;
           // this message is ready for sending back to main so push to send_msg_queue
           send_msg_queue.push(q_elm);
         }
         // back on main thread. If recv_msg_queue is empty then send a message back to main
         if (recv_msg_queue.empty()) process_send_queue_elm();
+
+        // periodically report to main through the same forwarder as the deltas
+        if (ClusterMetrics::now_ns() - last_report_ns >= telemetry_interval_ns) {
+          int destination_id = q_elm->data.msg_src;
+          if (destination_id > WorkerCluster::leader_proc)
+            destination_id = WorkerCluster::batch_fwd_to_delta_fwd(destination_id);
+          send_telemetry(destination_id);
+        }
       }
       else if (code == FLUSH) {
         // std::cout << "DistributedWorker: " << id << " flushing ..." << std::endl;
@@ -87,19 +110,25 @@ void DistributedWorker::run() {
         int destination_id = q_elm->data.msg_src;
         if (destination_id > WorkerCluster::leader_proc)
           destination_id = WorkerCluster::batch_fwd_to_delta_fwd(destination_id);
-        MPI_Send(nullptr, 0, MPI_CHAR, destination_id, FLUSH, MPI_COMM_WORLD);
+        send_telemetry(destination_id); // main sees the report before the flush completes
+        MPI_Send(nullptr, 0, MPI_CHAR, destination_id, FLUSH, WorkerCluster::comm);
         recv_msg_queue.push_back(q_elm);
       }
       else if (code == STOP) {
-        free(delta_node);
-        free(msg_buffer);
+#pragma omp taskwait
+        MsgBufferPool::get().trim(); // return this session's message memory
         WorkerCluster::send_upds_processed(num_updates.load()); // send number of updates to main
 
         // std::cout << "Number of updates processed = " << num_updates << std::endl;
 
         num_updates = 0;
+        num_batch_msgs = 0;
+        busy_ns = 0;
+        last_report_busy_ns = 0;
+        delta_gen_time.reset();
         recv_msg_queue.push_back(q_elm);
         init_worker(); // wait for init
+        if (running) prepare_handlers();
       }
       else if (code == SHUTDOWN) {
         running = false;
@@ -109,6 +138,7 @@ void DistributedWorker::run() {
         recv_msg_queue.push_back(q_elm);
       }
       else {
+        MsgBufferPool::get().release(std::exchange(q_elm->data.batches_buffer, nullptr));
         recv_msg_queue.push_back(q_elm);
         throw BadMessageException("DistributedWorker run() did not recognize message code");
       }
@@ -133,17 +163,49 @@ void DistributedWorker::init_worker() {
     throw BadMessageException("INIT message of wrong length");
 
   double sketches_factor;
+  int requested_handlers;
   memcpy(&num_nodes, init_buffer, sizeof(num_nodes));
   memcpy(&seed, init_buffer + sizeof(num_nodes), sizeof(seed));
   memcpy(&max_msg_size, init_buffer + sizeof(num_nodes) + sizeof(seed), sizeof(max_msg_size));
   memcpy(&sketches_factor, init_buffer + sizeof(num_nodes) + sizeof(seed) + sizeof(max_msg_size),
          sizeof(sketches_factor));
+  memcpy(&requested_handlers, init_buffer + sizeof(num_nodes) + sizeof(seed) +
+         sizeof(max_msg_size) + sizeof(sketches_factor), sizeof(requested_handlers));
+  num_handlers = requested_handlers > 0 ? requested_handlers : 2 * helper_threads;
 
   // std::cout << "DistributedWorker: " << id << " initialized!" << std::endl;
 
   Supernode::configure(num_nodes, Supernode::default_num_columns, sketches_factor);
-  delta_node = (Supernode *) malloc(Supernode::get_size());
-  msg_buffer = (char *) malloc(max_msg_size);
+}
+
+void DistributedWorker::prepare_handlers() {
+  if (recv_msg_queue.size() != num_allocated_handlers)
+    throw std::runtime_error("DistributedWorker: handlers in use when preparing for a session");
+
+  // Create recieve message queue (send message queue starts empty). The handlers
+  // are kept between sessions unless their number must change.
+  if (num_allocated_handlers != num_handlers) {
+    for (auto handler : recv_msg_queue)
+      delete handler;
+    recv_msg_queue.clear();
+    for (size_t i = 0; i < num_handlers; i++) {
+      BatchesToDeltasHandler msg_handler(WorkerCluster::num_batches);
+      MsgBufferQueue<BatchesToDeltasHandler>::QueueElm* q_elm =
+          new MsgBufferQueue<BatchesToDeltasHandler>::QueueElm(msg_handler);
+      recv_msg_queue.emplace_back(q_elm);
+    }
+    num_allocated_handlers = num_handlers;
+  }
+
+  // only remaps memory if this session's supernodes are larger than any before
+  supernode_arena.reserve(Supernode::get_size(),
+                          1 + recv_msg_queue.size() * WorkerCluster::num_batches);
+  delta_node = supernode_arena.get_slot(0);
+  size_t slot = 1;
+  for (auto q_elm : recv_msg_queue) {
+    for (auto &delta : q_elm->data.deltas)
+      delta.supernode = supernode_arena.get_slot(slot++);
+  }
 }
 
 void DistributedWorker::process_send_queue_elm() {
@@ -154,8 +216,44 @@ void DistributedWorker::process_send_queue_elm() {
   if (destination_id > WorkerCluster::leader_proc)
     destination_id = WorkerCluster::batch_fwd_to_delta_fwd(destination_id);
   // std::cout << "DistributedWorker: " << id << " returning deltas to " << data.msg_src << std::endl;
-  WorkerCluster::return_deltas(destination_id, data.serial_delta_mem, data.serial_stream.tellp());
-  data.serial_stream.reset();  // reset omemstream back to the beginning
+  TRACE_SPAN("return_deltas", TraceRecorder::first_node(data.delta_msg, data.delta_msg_size));
+  WorkerCluster::return_deltas(destination_id, data.delta_msg, data.delta_msg_size);
+  MsgBufferPool::get().release(std::exchange(data.delta_msg, nullptr));
 
   recv_msg_queue.push_back(q_elm);  // we've dealt with this queue elm so place it in recv
 }
+
+void DistributedWorker::send_telemetry(int dst_id) {
+  uint64_t now = ClusterMetrics::now_ns();
+  uint64_t busy = busy_ns.load();
+
+  WorkerTelemetry report;
+  report.worker_id = id;
+  report.num_handlers = num_allocated_handlers;
+  report.idle_handlers = recv_msg_queue.size();
+  report.pending_deltas = send_msg_queue.size();
+  report.num_updates = num_updates.load();
+  report.batch_msgs = num_batch_msgs.load();
+  report.utilization = std::min(1.0, (busy - last_report_busy_ns) /
+                                     ((double) (now - last_report_ns) * helper_threads));
+  report.delta_gen_p50_ns = delta_gen_time.percentile(0.5);
+  report.delta_gen_p99_ns = delta_gen_time.percentile(0.99);
+  report.delta_gen_max_ns = delta_gen_time.get_max();
+  report.memory = memory_report();
+  report.memory_bytes = report.memory.report().total();
+
+  MPI_Send(&report, sizeof(report), MPI_CHAR, dst_id, TELEMETRY, WorkerCluster::comm);
+  delta_gen_time.reset();
+  last_report_ns = now;
+  last_report_busy_ns = busy;
+}
+
+WorkerMemory DistributedWorker::memory_report() const {
+  WorkerMemory memory;
+  memory.arena_bytes = supernode_arena.get_capacity();
+  memory.msg_buffer_bytes = MsgBufferPool::get().get_bytes_allocated();
+  memory.handler_bytes = num_allocated_handlers *
+      (sizeof(MsgBufferQueue<BatchesToDeltasHandler>::QueueElm) +
+       WorkerCluster::num_batches * sizeof(delta_t));
+  return memory;
+}
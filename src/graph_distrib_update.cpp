@@ -3,38 +3,64 @@
 #include "distributed_worker.h"
 #include "message_forwarders.h"
 #include "worker_cluster.h"
+#include "certificate_graph.h"
+#include "msg_buffer_pool.h"
+#include "trace_recorder.h"
 #include <graph_worker.h>
 #include <mpi.h>
+#include <fcntl.h>
+#include <unistd.h>
 
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+#include <cstdint>
+#include <cstring>
 #include <iostream>
+#include <memory>
+#include <numeric>
+#include <streambuf>
+#include <thread>
 
-GraphConfiguration GraphDistribUpdate::graph_conf(node_id_t num_nodes, node_id_t k) {
+MemoryPlan GraphDistribUpdate::plan_graph(node_id_t num_nodes, node_id_t k, int num_inserters,
+                                          const DistribConfiguration &conf) {
   if (k == 0 || k > num_nodes) {
     throw std::invalid_argument("k must satisfy the following conditions 0 < k < num_nodes");
   }
+#ifdef USE_EAGER_DSU
+  // the eager DSU must see every update as it is inserted
+  if (conf._low_degree_threshold > 0) {
+    throw std::invalid_argument("The low degree hybrid mode does not support USE_EAGER_DSU");
+  }
+#endif
+  return MemoryPlan::make_for_graph(num_nodes, k, num_inserters, conf);
+}
+
+GraphConfiguration GraphDistribUpdate::graph_conf(node_id_t k, const DistribConfiguration &conf,
+                                                  const MemoryPlan &plan) {
   auto retval = GraphConfiguration()
 #ifdef USE_STANDALONE
           .gutter_sys(STANDALONE)
 #else
           .gutter_sys(CACHETREE)
 #endif
-          .disk_dir(".")
-          .backup_in_mem(true)
-          .num_graph_workers(1024)
-          .batch_factor(k > 1 ? 1.0 : 1.2)
+          .disk_dir(conf._backup_dir)
+          .backup_in_mem(conf._backup_in_mem)
+          .num_graph_workers(plan.num_graph_workers)
+          .batch_factor(plan.batch_factor)
           .sketches_factor(k);
   retval.gutter_conf()
           .page_factor(1)
-          .buffer_exp(20)
-          .fanout(64)
-          .queue_factor(WorkerCluster::num_batches)
-          .num_flushers(2)
+          .buffer_exp(plan.buffer_exp)
+          .fanout(plan.fanout)
+          .queue_factor(plan.queue_factor)
+          .num_flushers(plan.num_flushers)
           .wq_batch_per_elm(WorkerCluster::num_batches);
   return retval;
 }
 
 // Static functions for starting and shutting down the cluster
-void GraphDistribUpdate::setup_cluster(int argc, char** argv) {
+void GraphDistribUpdate::setup_cluster(int argc, char** argv, int num_leaders) {
   int provided;
   MPI_Init_thread(&argc, &argv, MPI_THREAD_MULTIPLE, &provided);
   // check if we were successfully able to use THREAD_MULTIPLE
@@ -45,30 +71,43 @@ void GraphDistribUpdate::setup_cluster(int argc, char** argv) {
 
   int num_machines;
   MPI_Comm_size(MPI_COMM_WORLD, &num_machines);
-  if (num_machines < WorkerCluster::distrib_worker_offset + 1) {
+  if (num_leaders < 1 || num_machines / num_leaders < WorkerCluster::distrib_worker_offset + 1) {
     std::cerr << "ERROR: Too few processes! Need at least "
-              << WorkerCluster::distrib_worker_offset + 1 << std::endl;
+              << WorkerCluster::distrib_worker_offset + 1 << " per leader" << std::endl;
     exit(EXIT_FAILURE);
   }
 
+  // each leader has its own forwarders and workers, proc_id is the rank within its cluster
+  WorkerCluster::split_leaders(num_leaders);
   int proc_id;
-  MPI_Comm_rank(MPI_COMM_WORLD, &proc_id);
+  MPI_Comm_rank(WorkerCluster::get_comm(), &proc_id);
+#ifdef LANDSCAPE_TRACE
+  int world_rank;
+  MPI_Comm_rank(MPI_COMM_WORLD, &world_rank);
+  std::string role = proc_id >= WorkerCluster::distrib_worker_offset ? "DistributedWorker"
+                   : proc_id > WorkerCluster::num_msg_forwarders ? "DeltaMessageForwarder"
+                   : proc_id > WorkerCluster::leader_proc ? "BatchMessageForwarder" : "Leader";
+  TraceRecorder::init(role + " " + std::to_string(world_rank));
+#endif
   if (proc_id >= WorkerCluster::distrib_worker_offset) {
     // we are a worker, start working!
     DistributedWorker worker(proc_id);
+    TraceRecorder::finish();
     MPI_Finalize();
     exit(EXIT_SUCCESS);
   } else if (proc_id > WorkerCluster::num_msg_forwarders) {
     DeltaMessageForwarder forwarder(proc_id);
+    TraceRecorder::finish();
     MPI_Finalize();
     exit(EXIT_SUCCESS);
-  } else if (proc_id > 0) {
+  } else if (proc_id > WorkerCluster::leader_proc) {
     BatchMessageForwarder forwarder(proc_id);
+    TraceRecorder::finish();
     MPI_Finalize();
     exit(EXIT_SUCCESS);
   }
 
-  if (proc_id != 0) {
+  if (proc_id != WorkerCluster::leader_proc) {
     std::cout << "ERROR: Incorrect main processes ID: " << proc_id << std::endl;
     exit(EXIT_FAILURE);
   }
@@ -77,6 +116,7 @@ void GraphDistribUpdate::setup_cluster(int argc, char** argv) {
 
 void GraphDistribUpdate::teardown_cluster() {
   WorkerCluster::shutdown_cluster();
+  TraceRecorder::finish(); // does nothing unless tracing
   MPI_Finalize();
 }
 
@@ -85,55 +125,814 @@ void GraphDistribUpdate::teardown_cluster() {
  ***************************************/
 
 // Construct a GraphDistribUpdate by first constructing a Graph
-GraphDistribUpdate::GraphDistribUpdate(node_id_t num_nodes, int num_inserters, node_id_t k) : 
- Graph(num_nodes, graph_conf(num_nodes, k), num_inserters), k(k) {
+GraphDistribUpdate::GraphDistribUpdate(node_id_t num_nodes, int num_inserters, node_id_t k,
+                                       DistribConfiguration conf) :
+ GraphDistribUpdate(num_nodes, num_inserters, k, conf,
+                    plan_graph(num_nodes, k, num_inserters, conf)) {}
+
+GraphDistribUpdate::GraphDistribUpdate(node_id_t num_nodes, int num_inserters, node_id_t k,
+                                       DistribConfiguration conf, const MemoryPlan &plan) :
+ Graph(num_nodes, graph_conf(k, conf, plan), num_inserters), k(k),
+ distrib_conf(conf), memory_plan(plan),
+ reset_threads(std::max(std::thread::hardware_concurrency(), 1u)),
+ inserters(new InserterState[num_inserters]), num_inserters(num_inserters) {
+  init_distributed();
+}
+
+// Restore a GraphDistribUpdate from a checkpoint
+GraphDistribUpdate::GraphDistribUpdate(const std::string &checkpoint_file, int num_inserters,
+                                       DistribConfiguration conf) :
+ GraphDistribUpdate(read_checkpoint_header(checkpoint_file), checkpoint_file, num_inserters,
+                    conf) {}
+
+GraphDistribUpdate::GraphDistribUpdate(const CheckpointHeader &header,
+                                       const std::string &checkpoint_file, int num_inserters,
+                                       DistribConfiguration conf, const MemoryPlan &plan) :
+ Graph(header.num_nodes, graph_conf(header.k, conf, plan), num_inserters),
+ k(header.k), distrib_conf(conf), memory_plan(plan),
+ reset_threads(std::max(std::thread::hardware_concurrency(), 1u)),
+ inserters(new InserterState[num_inserters]), num_inserters(num_inserters) {
+  if (header.serialized_size != Supernode::get_serialized_size()) {
+    delete[] inserters;
+    throw std::runtime_error("Checkpoint supernode size does not match this build");
+  }
+
+  // the seed must be restored before the workers are told it by start_workers
+  seed = header.seed;
+
+  int fd = open(checkpoint_file.c_str(), O_RDONLY);
+  if (fd < 0) {
+    delete[] inserters;
+    throw std::runtime_error("Could not open checkpoint " + checkpoint_file + ": " +
+                             strerror(errno));
+  }
+  auto start = std::chrono::steady_clock::now();
+  size_t bytes;
+  try {
+    bytes = read_supernodes(fd);
+  } catch (...) {
+    close(fd);
+    delete[] inserters;
+    throw;
+  }
+  close(fd);
+  std::chrono::duration<double> time = std::chrono::steady_clock::now() - start;
+  std::cout << "Restored " << bytes / 1e9 << " GB from checkpoint in " << time.count()
+            << " seconds (" << bytes / 1e9 / time.count() << " GB/s)" << std::endl;
+
+  init_distributed();
+  // the checkpoint holds the exact edges of low degree vertices in their sketches
+  if (low_degree != nullptr) low_degree->promote_all();
+}
+
+void GraphDistribUpdate::init_distributed() {
   // TODO: figure out a better solution than this.
   GraphWorker::stop_workers(); // shutdown the graph workers because we aren't using them
+  int leader = WorkerCluster::get_leader_id();
+  leader_first = WorkerCluster::leader_first_node(leader, num_nodes);
+  leader_last = WorkerCluster::leader_first_node(leader + 1, num_nodes);
+  if (WorkerCluster::get_num_leaders() > 1) {
+    std::cout << "Leader " << leader << " of " << WorkerCluster::get_num_leaders()
+              << " owns nodes [" << leader_first << ", " << leader_last << ")" << std::endl;
+  }
+  if (distrib_conf._low_degree_threshold > 0)
+    low_degree = new LowDegreeAdjacency(num_nodes, distrib_conf._low_degree_threshold);
+  if (distrib_conf._numa_aware) {
+    numa = new NumaTopology();
+    std::cout << "NUMA nodes on leader = " << numa->get_num_nodes() << std::endl;
+    if (numa->get_num_nodes() > 1) place_supernodes();
+  }
+  std::cout << memory_plan << std::endl;
   WorkDistributor::start_workers(this, gts); // start threads and distributed cluster
 #ifdef USE_EAGER_DSU
   std::cout << "USING EAGER_DSU" << std::endl;
 #endif
+  std::cout << distrib_conf << std::endl;
   std::cout << "Beginning stream ingestion!" << std::endl;
 }
 
 GraphDistribUpdate::~GraphDistribUpdate() {
+  stop_snapshots();
+
+  // wait for any asynchronous queries to finish with the graph
+  std::unique_lock<std::mutex> lk(async_lock);
+  async_cond.wait(lk, [this]{ return async_outstanding == 0; });
+  lk.unlock();
+
   // inform the worker threads they should wait for new init or shutdown
   uint64_t updates = WorkDistributor::stop_workers();
   std::cout << "Total updates processed by cluster since last init = " << updates << std::endl;
+  std::cout << WorkDistributor::get_bottleneck_report() << std::endl;
+  std::cout << "Leader Memory:" << std::endl << memory_report() << std::endl;
+  std::vector<WorkerTelemetry> reports = ClusterMetrics::get_telemetry();
+  auto largest = std::max_element(reports.begin(), reports.end(),
+      [](const WorkerTelemetry &a, const WorkerTelemetry &b) {
+        return a.memory_bytes < b.memory_bytes;
+      });
+  if (largest != reports.end()) {
+    std::cout << "Largest Worker Memory (worker " << largest->worker_id << " of "
+              << reports.size() << "):" << std::endl << largest->memory.report() << std::endl;
+  }
+  if (low_degree != nullptr) {
+    std::cout << "Vertices promoted out of exact adjacency = " << low_degree->get_num_promoted()
+              << std::endl;
+    delete low_degree;
+  }
+  delete numa;
+  delete[] inserters;
+}
+
+uint64_t GraphDistribUpdate::get_num_updates() const {
+  uint64_t total = 0;
+  for (int i = 0; i < num_inserters; i++)
+    total += inserters[i].count.load(std::memory_order_relaxed);
+  return total;
+}
+
+MemoryReport GraphDistribUpdate::memory_report() const {
+  MemoryReport report;
+  report.add("supernodes", (size_t) num_nodes * Supernode::get_size());
+  report.add("query backup", memory_plan.backup_bytes, true);
+  report.add("gutters", memory_plan.gutter_bytes, true);
+  report.add("cache tree", memory_plan.cache_tree_bytes, true);
+  report.add("work queue", memory_plan.work_queue_bytes, true);
+  report.add("low degree adjacency", low_degree == nullptr ? 0 : low_degree->get_bytes());
+  report.add("message buffers", MsgBufferPool::get().get_bytes_allocated());
+  report.add("distributor supernodes", WorkDistributor::get_arena_bytes());
+
+  // measure at most once per query, and never make a query wait for it
+  std::unique_lock<std::mutex> lk(query_lock, std::try_to_lock);
+  if (lk.owns_lock() && measured_version != query_state_version) {
+    measure_query_state();
+    measured_version = query_state_version;
+  }
+  report.add("query state", query_state_bytes);
+  return report;
+}
+
+void GraphDistribUpdate::measure_query_state() const {
+  // set elements are approximated as their value and a pointer per link
+  constexpr size_t hash_node_bytes = sizeof(void *) + sizeof(node_id_t);
+  constexpr size_t tree_node_bytes = 4 * sizeof(void *) + sizeof(node_id_t);
+
+  size_t bytes = (size_t) num_nodes * (sizeof(*parent) + sizeof(*size));
+  for (node_id_t i = 0; i < num_nodes; i++) {
+    bytes += sizeof(spanning_forest[i]) + spanning_forest[i].bucket_count() * sizeof(void *) +
+             spanning_forest[i].size() * hash_node_bytes;
+  }
+  for (auto &adj : kf_cache) bytes += sizeof(adj) + adj.size() * tree_node_bytes;
+  query_state_bytes = bytes;
+}
+
+void GraphDistribUpdate::defer_updates(InserterState &ins, const GraphUpdate *upds,
+                                       size_t num_upds) {
+  std::lock_guard<std::mutex> lk(ins.deferred_lock);
+  ins.deferred.insert(ins.deferred.end(), upds, upds + num_upds);
+  ins.has_deferred = true;
+}
+
+void GraphDistribUpdate::replay_deferred(InserterState &ins, int thr_id) {
+  std::vector<GraphUpdate> to_replay;
+  {
+    std::lock_guard<std::mutex> lk(ins.deferred_lock);
+    std::swap(to_replay, ins.deferred);
+    ins.has_deferred = false;
+  }
+  insert_updates(to_replay.data(), to_replay.size(), thr_id);
+}
+
+void GraphDistribUpdate::update_batch(const GraphUpdate *upds, size_t num_upds, int thr_id) {
+  InserterState &ins = inserters[thr_id];
+
+  // a query waits for the current chunk so chunks bound how long an inserter delays it
+  for (size_t first = 0; first < num_upds; first += update_batch_chunk) {
+    size_t chunk = std::min(update_batch_chunk, num_upds - first);
+
+    // sequentially consistent to pair with quiesce_inserters()
+    ins.in_update.store(true);
+    if (query_pending.load()) {
+      ins.in_update.store(false, std::memory_order_release);
+      defer_updates(ins, upds + first, chunk);
+    } else {
+      try {
+        if (ins.has_deferred.load(std::memory_order_relaxed)) replay_deferred(ins, thr_id);
+        insert_updates(upds + first, chunk, thr_id);
+      } catch (...) {
+        ins.in_update.store(false, std::memory_order_release);
+        throw;
+      }
+      ins.in_update.store(false, std::memory_order_release);
+    }
+    ins.count.store(ins.count.load(std::memory_order_relaxed) + chunk, std::memory_order_relaxed);
+  }
+}
+
+void GraphDistribUpdate::insert_updates(const GraphUpdate *upds, size_t num_upds, int thr_id) {
+#ifdef USE_EAGER_DSU
+  // the eager DSU must see every update through Graph::update()
+  for (size_t i = 0; i < num_upds; i++) insert_update(upds[i], thr_id);
+#else
+  if (low_degree != nullptr) {
+    for (size_t i = 0; i < num_upds; i++)
+      if (owns_edge(upds[i].edge)) insert_low_degree(upds[i], thr_id);
+    return;
+  }
+  if (update_locked) throw UpdateLockedException();
+
+  // each endpoint's sketch receives the edge. Sorting the directed edges by
+  // their first node makes consecutive inserts touch the same gutter.
+  thread_local std::vector<update_t> directed;
+  directed.clear();
+  for (size_t i = 0; i < num_upds; i++) {
+    if (!owns_edge(upds[i].edge)) continue;
+    directed.push_back({upds[i].edge.src, upds[i].edge.dst});
+    directed.push_back({upds[i].edge.dst, upds[i].edge.src});
+  }
+  std::sort(directed.begin(), directed.end(), [](const update_t &a, const update_t &b) {
+    return a.first < b.first;
+  });
+  for (auto &upd : directed) gts->insert(upd, thr_id);
+  dsu_valid = false;
+#endif
+}
+
+void GraphDistribUpdate::place_supernodes() {
+  auto start = std::chrono::steady_clock::now();
+  std::vector<std::thread> threads;
+  for (size_t node = 0; node < numa->get_num_nodes(); node++) {
+    node_id_t first = numa->first_vertex(node, num_nodes);
+    node_id_t last = numa->first_vertex(node + 1, num_nodes);
+    size_t node_threads = numa->get_cpus(node).size();
+    for (size_t t = 0; t < node_threads; t++) {
+      node_id_t begin = first + (last - first) * t / node_threads;
+      node_id_t end = first + (last - first) * (t + 1) / node_threads;
+      threads.emplace_back([this, node, begin, end]() {
+        numa->pin_thread(node);
+        // the copy is allocated and first touched by a cpu of the owning node
+        for (node_id_t i = begin; i < end; i++) {
+          Supernode *local = Supernode::makeSupernode(*supernodes[i]);
+          free(supernodes[i]);
+          supernodes[i] = local;
+        }
+      });
+    }
+  }
+  for (auto &thr : threads) thr.join();
+  std::chrono::duration<double> time = std::chrono::steady_clock::now() - start;
+  std::cout << "Placed supernodes across NUMA nodes in " << time.count() << " seconds"
+            << std::endl;
+}
+
+void GraphDistribUpdate::insert_low_degree(GraphUpdate upd, int thr_id) {
+  if (update_locked) throw UpdateLockedException();
+
+  // the edge goes to the sketches of both endpoints unless it is kept exactly
+  thread_local std::vector<Edge> spill;
+  Edge edge = upd.edge;
+  if (!low_degree->toggle(edge.src, edge.dst, spill)) {
+    spill.push_back(edge);
+    for (Edge e : spill) {
+      gts->insert({e.src, e.dst}, thr_id);
+      gts->insert({e.dst, e.src}, thr_id);
+    }
+    spill.clear();
+  }
+  dsu_valid = false;
+}
+
+bool GraphDistribUpdate::merge_components(node_id_t a, node_id_t b) {
+  a = get_parent(a);
+  b = get_parent(b);
+  if (a == b) return false;
+  if (size[a] < size[b]) std::swap(a, b);
+  parent[b] = a;
+  size[a] += size[b];
+  return true;
+}
+
+bool GraphDistribUpdate::merge_low_degree_edges() {
+  if (low_degree == nullptr) return false;
+
+  std::vector<Edge> exact;
+  low_degree->get_edges(exact);
+  bool merged = false;
+  for (Edge e : exact) {
+    if (merge_components(e.src, e.dst)) {
+      spanning_forest[e.src].insert(e.dst);
+      merged = true;
+    }
+  }
+  return merged;
+}
+
+void GraphDistribUpdate::toggle_in_supernodes(const std::vector<Edge> &edges) {
+  for (Edge e : edges) {
+    supernodes[e.src]->update(concat_pairing_fn(e.src, e.dst));
+    supernodes[e.dst]->update(concat_pairing_fn(e.src, e.dst));
+  }
+}
+
+void GraphDistribUpdate::quiesce_inserters() {
+  query_pending = true;
+  for (int i = 0; i < num_inserters; i++) {
+    while (inserters[i].in_update.load())
+      std::this_thread::yield();
+  }
+
+  // no inserter is using the guttering system so we may do so on their behalf
+  for (int i = 0; i < num_inserters; i++) {
+    if (inserters[i].has_deferred.load())
+      replay_deferred(inserters[i], i);
+  }
+}
+
+namespace {
+double seconds_since(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+// copies the phases of a query to the caller as it returns, while query_lock is held
+class PhasesOut {
+  const QueryPhases &phases;
+  QueryPhases *out;
+ public:
+  PhasesOut(const QueryPhases &phases, QueryPhases *out) : phases(phases), out(out) {}
+  ~PhasesOut() { if (out != nullptr) *out = phases; }
+};
+
+// A stream over a block of memory with a contiguous get and put area so that
+// reads and writes of serialized supernodes are single memcpys.
+class BlockBuf : public std::streambuf {
+ public:
+  BlockBuf(char *buf, size_t size) {
+    setg(buf, buf, buf + size);
+    setp(buf, buf + size);
+  }
+  size_t bytes_written() const { return pptr() - pbase(); }
+};
+
+// transfer all len bytes at offset, retrying partial transfers
+template <class IO, class Buf>
+void full_io(IO io, int fd, Buf buf, size_t len, off_t offset, const char *what) {
+  size_t done = 0;
+  while (done < len) {
+    ssize_t ret = io(fd, buf + done, len - done, offset + done);
+    if (ret < 0 && errno == EINTR) continue;
+    if (ret <= 0)
+      throw std::runtime_error(std::string("Checkpoint ") + what + " failed: " +
+                               (ret < 0 ? strerror(errno) : "unexpected end of file"));
+    done += ret;
+  }
+}
+} // namespace
+
+GraphDistribUpdate::CheckpointHeader GraphDistribUpdate::read_checkpoint_header(
+    const std::string &checkpoint_file) {
+  require_single_leader("Restoring a checkpoint");
+  std::ifstream in(checkpoint_file, std::ios::binary);
+  if (!in.is_open())
+    throw std::runtime_error("Could not open checkpoint " + checkpoint_file);
+
+  CheckpointHeader header;
+  in.read((char *)&header, sizeof(header));
+  if (!in || memcmp(header.magic, "LSCKPT01", sizeof(header.magic)) != 0)
+    throw std::runtime_error(checkpoint_file + " is not a Landscape checkpoint");
+  return header;
+}
+
+size_t GraphDistribUpdate::write_supernodes(int fd) {
+  size_t serialized_size = Supernode::get_serialized_size();
+  node_id_t per_block = std::max(checkpoint_block_size / serialized_size, (size_t)1);
+  node_id_t num_blocks = (num_nodes + per_block - 1) / per_block;
+  size_t buffer_bytes = (size_t)std::min(per_block, num_nodes) * serialized_size;
+
+  bool failed = false;
+  std::exception_ptr err;
+#pragma omp parallel num_threads(std::min<node_id_t>(reset_threads, num_blocks))
+  {
+    std::unique_ptr<char[]> buffer; // allocated once this thread claims a block
+#pragma omp for schedule(dynamic, 1)
+    for (node_id_t b = 0; b < num_blocks; b++) {
+      if (!buffer) buffer.reset(new char[buffer_bytes]);
+      node_id_t first = b * per_block;
+      node_id_t last = std::min(first + per_block, num_nodes);
+      BlockBuf block(buffer.get(), buffer_bytes);
+      std::ostream out(&block);
+      for (node_id_t i = first; i < last; i++)
+        supernodes[i]->write_binary(out);
+
+      try {
+        full_io(pwrite, fd, (const char *)buffer.get(), block.bytes_written(),
+                checkpoint_header_size + first * serialized_size, "write");
+      } catch (...) {
+#pragma omp critical
+        {
+          failed = true;
+          err = std::current_exception();
+        }
+      }
+    }
+  }
+  if (failed) std::rethrow_exception(err);
+  return (size_t)num_nodes * serialized_size;
+}
+
+size_t GraphDistribUpdate::read_supernodes(int fd) {
+  size_t serialized_size = Supernode::get_serialized_size();
+  node_id_t per_block = std::max(checkpoint_block_size / serialized_size, (size_t)1);
+  node_id_t num_blocks = (num_nodes + per_block - 1) / per_block;
+  size_t buffer_bytes = (size_t)std::min(per_block, num_nodes) * serialized_size;
+
+  bool failed = false;
+  std::exception_ptr err;
+#pragma omp parallel num_threads(std::min<node_id_t>(reset_threads, num_blocks))
+  {
+    std::unique_ptr<char[]> buffer; // allocated once this thread claims a block
+#pragma omp for schedule(dynamic, 1)
+    for (node_id_t b = 0; b < num_blocks; b++) {
+      if (!buffer) buffer.reset(new char[buffer_bytes]);
+      node_id_t first = b * per_block;
+      node_id_t last = std::min(first + per_block, num_nodes);
+      try {
+        full_io(pread, fd, buffer.get(), (last - first) * serialized_size,
+                checkpoint_header_size + first * serialized_size, "read");
+      } catch (...) {
+#pragma omp critical
+        {
+          failed = true;
+          err = std::current_exception();
+        }
+        continue;
+      }
+
+      // construct each supernode in the memory the Graph allocated for it
+      BlockBuf block(buffer.get(), buffer_bytes);
+      std::istream in(&block);
+      for (node_id_t i = first; i < last; i++)
+        Supernode::makeSupernode(num_nodes, seed, in, supernodes[i]);
+    }
+  }
+  if (failed) std::rethrow_exception(err);
+  return (size_t)num_nodes * serialized_size;
+}
+
+void GraphDistribUpdate::checkpoint(const std::string &checkpoint_file) {
+  require_single_leader("checkpoint()");
+  std::lock_guard<std::mutex> lk(query_lock);
+
+  auto start = std::chrono::steady_clock::now();
+  quiesce_inserters(); // stop the inserters from touching the guttering system
+  gts->force_flush(); // flush everything in buffering system to make final updates
+  WorkDistributor::pause_workers(); // wait for the workers to finish applying the updates
+
+  // The checkpoint holds every edge in its sketches. The exact low degree
+  // edges are added to the supernodes while they are written.
+  std::vector<Edge> exact;
+  if (low_degree != nullptr) low_degree->get_edges(exact);
+  toggle_in_supernodes(exact);
+
+  // Only the WorkDistributors modify the supernodes so the inserters may fill
+  // the guttering system while the checkpoint is written.
+  release_inserters();
+  auto write_start = std::chrono::steady_clock::now();
+
+  size_t bytes = 0;
+  std::exception_ptr err;
+  int fd = open(checkpoint_file.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  try {
+    if (fd < 0)
+      throw std::runtime_error("Could not open checkpoint " + checkpoint_file + ": " +
+                               strerror(errno));
+    CheckpointHeader header;
+    memcpy(header.magic, "LSCKPT01", sizeof(header.magic));
+    header.num_nodes = num_nodes;
+    header.seed = seed;
+    header.k = k;
+    header.serialized_size = Supernode::get_serialized_size();
+    char header_block[checkpoint_header_size] = {};
+    memcpy(header_block, &header, sizeof(header));
+    full_io(pwrite, fd, (const char *)header_block, checkpoint_header_size, 0, "write");
+
+    bytes = write_supernodes(fd) + checkpoint_header_size;
+    if (fsync(fd) != 0)
+      throw std::runtime_error(std::string("Checkpoint fsync failed: ") + strerror(errno));
+  } catch (...) {
+    err = std::current_exception();
+  }
+  if (fd >= 0) close(fd);
+  toggle_in_supernodes(exact);
+  WorkDistributor::unpause_workers();
+  if (err) std::rethrow_exception(err);
+
+  auto end = std::chrono::steady_clock::now();
+  std::chrono::duration<double> flush_time = write_start - start;
+  std::chrono::duration<double> write_time = end - write_start;
+  std::cout << "Checkpoint of " << bytes / 1e9 << " GB: flush " << flush_time.count()
+            << " seconds, write " << write_time.count() << " seconds ("
+            << bytes / 1e9 / write_time.count() << " GB/s)" << std::endl;
+}
+
+template <class Ret, class Query>
+std::future<Ret> GraphDistribUpdate::submit_query(Query query) {
+  {
+    std::lock_guard<std::mutex> lk(async_lock);
+    ++async_outstanding;
+  }
+  return std::async(std::launch::async, [this, query]() {
+    // mark this query as finished even if it throws
+    struct Finished {
+      GraphDistribUpdate *g;
+      ~Finished() {
+        std::lock_guard<std::mutex> lk(g->async_lock);
+        --g->async_outstanding;
+        g->async_cond.notify_all();
+      }
+    } finished{this};
+    return query();
+  });
+}
+
+std::future<std::vector<std::set<node_id_t>>> GraphDistribUpdate::submit_cc_query(
+    QueryStaleness staleness) {
+  return submit_query<std::vector<std::set<node_id_t>>>([this, staleness]() {
+    return get_connected_components(true, staleness);
+  });
+}
+
+std::future<bool> GraphDistribUpdate::submit_point_query(node_id_t a, node_id_t b,
+                                                         QueryStaleness staleness) {
+  return submit_query<bool>([this, a, b, staleness]() {
+    return point_to_point_query(a, b, staleness);
+  });
+}
+
+void GraphDistribUpdate::start_snapshots(uint64_t update_interval,
+    std::chrono::milliseconds time_interval,
+    std::function<void(const ConnectivitySnapshot &)> callback, const std::string &output_file) {
+  if (update_interval == 0 && time_interval.count() <= 0)
+    throw std::invalid_argument("start_snapshots(): at least one interval must be non-zero");
+  // the leaders would take their snapshots at different times
+  require_single_leader("start_snapshots()");
+  stop_snapshots(); // replace any snapshots already running
+
+  snapshot_update_interval = update_interval;
+  snapshot_time_interval = time_interval;
+  snapshot_callback = callback;
+  if (!output_file.empty()) {
+    snapshot_out.open(output_file, std::ios_base::out | std::ios_base::app);
+    if (!snapshot_out.is_open())
+      throw std::runtime_error("start_snapshots(): could not open " + output_file);
+    snapshot_out << std::fixed;
+  }
+  snapshot_stop = false;
+  snapshot_thread = std::thread(&GraphDistribUpdate::snapshot_loop, this);
+}
+
+void GraphDistribUpdate::stop_snapshots() {
+  if (!snapshot_thread.joinable()) return;
+  {
+    std::lock_guard<std::mutex> lk(snapshot_lock);
+    snapshot_stop = true;
+  }
+  snapshot_cond.notify_all();
+  snapshot_thread.join();
+  if (snapshot_out.is_open()) snapshot_out.close();
+}
+
+void GraphDistribUpdate::snapshot_loop() {
+  // how often we check whether a snapshot is due
+  constexpr std::chrono::milliseconds poll_interval(10);
+
+  size_t index = 0;
+  uint64_t last_updates = get_num_updates();
+  auto last_time = std::chrono::steady_clock::now();
+
+  std::unique_lock<std::mutex> lk(snapshot_lock);
+  while (true) {
+    snapshot_cond.wait_for(lk, poll_interval, [this]{ return snapshot_stop; });
+    if (snapshot_stop) return;
+
+    uint64_t cur_updates = get_num_updates();
+    auto now = std::chrono::steady_clock::now();
+    bool due = (snapshot_update_interval > 0 &&
+                cur_updates - last_updates >= snapshot_update_interval) ||
+               (snapshot_time_interval.count() > 0 && now - last_time >= snapshot_time_interval);
+    if (!due) continue;
+    last_updates = cur_updates;
+    last_time = now;
+
+    // perform the query without holding the lock so that stop_snapshots() is not blocked
+    lk.unlock();
+    ConnectivitySnapshot snapshot;
+    snapshot.index = index++;
+    snapshot.num_updates = cur_updates;
+    try {
+      {
+        // read the latencies before another query can overwrite them
+        std::lock_guard<std::mutex> query_lk(query_lock);
+        snapshot.components = connected_components_locked(true, QueryStaleness());
+        snapshot.flush_latency = std::chrono::duration<double>(flush_end - flush_start).count();
+        snapshot.alg_latency = std::chrono::duration<double>(cc_alg_end - cc_alg_start).count();
+      }
+
+      if (snapshot_out.is_open()) {
+        snapshot_out << snapshot.index << ", " << snapshot.num_updates << ", "
+                     << snapshot.components.size() << ", " << snapshot.flush_latency << ", "
+                     << snapshot.alg_latency << std::endl;
+      }
+      if (snapshot_callback) snapshot_callback(snapshot);
+    } catch (std::exception &e) {
+      std::cerr << "ERROR: Connectivity snapshot " << snapshot.index << " failed: " << e.what()
+                << std::endl;
+    }
+    lk.lock();
+  }
+}
+
+bool GraphDistribUpdate::is_fresh(const QuerySnapshot &snapshot, QueryStaleness staleness) const {
+  if (!snapshot.valid) return false;
+  if (get_num_updates() - snapshot.num_updates <= staleness.max_updates) return true;
+  return staleness.max_age.count() > 0 &&
+         std::chrono::steady_clock::now() - snapshot.time <= staleness.max_age;
+}
+
+void GraphDistribUpdate::flush_for_query() {
+  flush_start = std::chrono::steady_clock::now();
+  quiesce_inserters(); // stop the inserters from touching the guttering system
+  gts->force_flush(); // flush everything in buffering system to make final updates
+  query_phases.flush = seconds_since(flush_start);
+
+  auto pause_start = std::chrono::steady_clock::now();
+  WorkDistributor::pause_workers(); // wait for the workers to finish applying the updates
+  flush_end = std::chrono::steady_clock::now();
+  query_phases.pause = std::chrono::duration<double>(flush_end - pause_start).count();
+  // after this point all updates have been processed from the guttering system
+}
+
+void GraphDistribUpdate::resume_after_query() {
+  // Inserters only touch the guttering system so they may resume while the
+  // supernodes are reset. The WorkDistributors apply deltas to the supernodes
+  // so they remain paused until the reset is complete.
+  update_locked = false;
+  release_inserters();
+
+  auto reset_start = std::chrono::steady_clock::now();
+#pragma omp parallel for num_threads(reset_threads) schedule(static)
+  for (node_id_t i = 0; i < num_nodes; i++) {
+    supernodes[i]->reset_query_state();
+  }
+  query_phases.reset = seconds_since(reset_start);
+
+  auto unpause_start = std::chrono::steady_clock::now();
+  WorkDistributor::unpause_workers();
+  query_phases.unpause = seconds_since(unpause_start);
+  query_state_version++;
+}
+
+std::vector<std::set<node_id_t>> GraphDistribUpdate::get_connected_components(bool cont,
+    QueryStaleness staleness, QueryPhases *phases) {
+  std::lock_guard<std::mutex> lk(query_lock);
+  PhasesOut phases_out(query_phases, phases);
+  std::vector<std::set<node_id_t>> ret = connected_components_locked(cont, staleness);
+  if (WorkerCluster::get_num_leaders() == 1) return ret;
+
+  // joining the components of the leaders is part of computing the result
+  auto merge_start = std::chrono::steady_clock::now();
+  ret = merge_leader_components(ret);
+  cc_alg_end = std::chrono::steady_clock::now();
+  query_phases.result += std::chrono::duration<double>(cc_alg_end - merge_start).count();
+  return ret;
+}
+
+std::vector<std::set<node_id_t>> GraphDistribUpdate::merge_leader_components(
+    const std::vector<std::set<node_id_t>> &components) const {
+  // each component is sent as a star from its smallest node to its other nodes
+  std::vector<Edge> star;
+  for (auto &cc : components) {
+    for (node_id_t v : cc)
+      if (v != *cc.begin()) star.push_back({*cc.begin(), v});
+  }
+  if (star.size() > INT_MAX)
+    throw std::overflow_error("merge_leader_components(): too many edges to send");
+
+  MPI_Comm leaders = WorkerCluster::get_leader_comm();
+  int num_leaders = WorkerCluster::get_num_leaders();
+  int count = star.size();
+  std::vector<int> counts(num_leaders);
+  std::vector<int> displs(num_leaders);
+  MPI_Allgather(&count, 1, MPI_INT, counts.data(), 1, MPI_INT, leaders);
+  size_t total = 0;
+  for (int l = 0; l < num_leaders; l++) {
+    displs[l] = total;
+    total += counts[l];
+    if (total > INT_MAX)
+      throw std::overflow_error("merge_leader_components(): too many edges to receive");
+  }
+
+  MPI_Datatype edge_type;
+  MPI_Type_contiguous(sizeof(Edge), MPI_BYTE, &edge_type);
+  MPI_Type_commit(&edge_type);
+  std::vector<Edge> edges(total);
+  MPI_Allgatherv(star.data(), count, edge_type, edges.data(), counts.data(), displs.data(),
+                 edge_type, leaders);
+  MPI_Type_free(&edge_type);
+
+  // a DSU separate from the Graph's, which holds only this leader's components
+  std::vector<node_id_t> root(num_nodes);
+  std::iota(root.begin(), root.end(), 0);
+  auto find = [&root](node_id_t v) {
+    while (root[v] != v) {
+      root[v] = root[root[v]];
+      v = root[v];
+    }
+    return v;
+  };
+  for (Edge e : edges) {
+    node_id_t a = find(e.src);
+    node_id_t b = find(e.dst);
+    if (a != b) root[std::max(a, b)] = std::min(a, b);
+  }
+
+  std::vector<std::set<node_id_t>> ret;
+  std::vector<size_t> index(num_nodes, SIZE_MAX);
+  for (node_id_t v = 0; v < num_nodes; v++) {
+    node_id_t r = find(v);
+    if (index[r] == SIZE_MAX) {
+      index[r] = ret.size();
+      ret.emplace_back();
+    }
+    ret[index[r]].insert(v);
+  }
+  return ret;
+}
+
+void GraphDistribUpdate::require_single_leader(const std::string &query) {
+  if (WorkerCluster::get_num_leaders() > 1)
+    throw std::logic_error(query + " is not supported with multiple leaders");
 }
 
-std::vector<std::set<node_id_t>> GraphDistribUpdate::get_connected_components(bool cont) {
+std::vector<std::set<node_id_t>> GraphDistribUpdate::connected_components_locked(bool cont,
+    QueryStaleness staleness) {
+  query_phases = QueryPhases();
+
   // DSU check before calling force_flush()
-  if (dsu_valid && cont) {
+  // The DSU is only written by queries so it remains a (stale) answer after updates
+  if (cont && (dsu_valid || is_fresh(dsu_snapshot, staleness))) {
     cc_alg_start = flush_start = flush_end = std::chrono::steady_clock::now();
     std::cout << "~ Used existing DSU" << std::endl;
 #ifdef VERIFY_SAMPLES_F
-    for (node_id_t src = 0; src < num_nodes; ++src) {
-      for (const auto& dst : spanning_forest[src]) {
-        verifier->verify_edge({src, dst});
+    if (dsu_valid) {
+      for (node_id_t src = 0; src < num_nodes; ++src) {
+        for (const auto& dst : spanning_forest[src]) {
+          verifier->verify_edge({src, dst});
+        }
       }
     }
 #endif
     auto retval = cc_from_dsu();
     cc_alg_end = std::chrono::steady_clock::now();
+    query_phases.cached = true;
+    query_phases.result = std::chrono::duration<double>(cc_alg_end - cc_alg_start).count();
     return retval;
   }
 
-  flush_start = std::chrono::steady_clock::now();
-  gts->force_flush(); // flush everything in buffering system to make final updates
-  WorkDistributor::pause_workers(); // wait for the workers to finish applying the updates
-  flush_end = std::chrono::steady_clock::now();
-  // after this point all updates have been processed from the guttering system
+  uint64_t snapshot_updates = get_num_updates();
+  dsu_snapshot.valid = false;
+  flush_for_query();
 
-  if (!cont)
-    return boruvka_emulation(false); // merge in place
+  if (!cont) {
+    // merge in place. Afterwards the graph is locked so inserters will see an exception
+    std::vector<std::set<node_id_t>> ret;
+    auto boruvka_start = std::chrono::steady_clock::now();
+    try {
+      ret = boruvka_emulation(false);
+    } catch (...) {
+      release_inserters();
+      throw;
+    }
+    query_phases.boruvka = seconds_since(boruvka_start);
+    auto result_start = std::chrono::steady_clock::now();
+    if (merge_low_degree_edges()) ret = cc_from_dsu();
+    query_phases.result = seconds_since(result_start);
+    release_inserters();
+    query_state_version++;
+    return ret;
+  }
   
   // if backing up in memory then perform copying in boruvka
   bool except = false;
   std::exception_ptr err;
   std::vector<std::set<node_id_t>> ret;
+  // the components are built from the DSU within boruvka_emulation
+  auto boruvka_start = std::chrono::steady_clock::now();
   try {
     ret = boruvka_emulation(true);
+    query_phases.boruvka = seconds_since(boruvka_start);
+    // the sketches hold the edges of promoted vertices, the exact edges join their components
+    auto result_start = std::chrono::steady_clock::now();
+    if (merge_low_degree_edges()) ret = cc_from_dsu();
+    query_phases.result = seconds_since(result_start);
+    dsu_snapshot = {true, snapshot_updates, flush_start};
   } catch (...) {
     except = true;
     err = std::current_exception();
@@ -141,11 +940,7 @@ std::vector<std::set<node_id_t>> GraphDistribUpdate::get_connected_components(bo
 
   // get ready for ingesting more from the stream
   // reset dsu and resume graph workers
-  for (node_id_t i = 0; i < num_nodes; i++) {
-    supernodes[i]->reset_query_state();
-  }
-  update_locked = false;
-  WorkDistributor::unpause_workers();
+  resume_after_query();
 
   // check if boruvka errored
   if (except) std::rethrow_exception(err);
@@ -153,30 +948,54 @@ std::vector<std::set<node_id_t>> GraphDistribUpdate::get_connected_components(bo
   return ret;
 }
 
-std::vector<std::set<node_id_t>> GraphDistribUpdate::k_spanning_forests(node_id_t user_k) {
+std::vector<std::set<node_id_t>> GraphDistribUpdate::k_spanning_forests(node_id_t user_k,
+    QueryStaleness staleness, QueryPhases *phases) {
   if (user_k > k) {
     throw std::invalid_argument("Requested k out of range 0 < k < " + std::to_string(k));
   }
+  require_single_leader("k_spanning_forests()");
+  std::lock_guard<std::mutex> lk(query_lock);
+  PhasesOut phases_out(query_phases, phases);
+  return k_spanning_forests_locked(user_k, staleness);
+}
 
-  flush_start = std::chrono::steady_clock::now();
-  gts->force_flush(); // flush everything in buffering system to make final updates
-  WorkDistributor::pause_workers(); // wait for the workers to finish applying the updates
-  flush_end = std::chrono::steady_clock::now();
-  // after this point all updates have been processed from the guttering system
+std::vector<std::set<node_id_t>> GraphDistribUpdate::k_spanning_forests_locked(node_id_t user_k,
+    QueryStaleness staleness) {
+  query_phases = QueryPhases();
+
+  if (kf_cache_k == user_k && is_fresh(kf_snapshot, staleness)) {
+    cc_alg_start = flush_start = flush_end = std::chrono::steady_clock::now();
+    std::cout << "~ Used cached spanning forests" << std::endl;
+    cc_alg_end = std::chrono::steady_clock::now();
+    query_phases.cached = true;
+    query_phases.result = std::chrono::duration<double>(cc_alg_end - cc_alg_start).count();
+    return kf_cache;
+  }
+
+  uint64_t snapshot_updates = get_num_updates();
+  kf_snapshot.valid = false;
+  flush_for_query();
 
   auto k_cc_start = std::chrono::steady_clock::now();
   std::vector<std::set<node_id_t>> adj_list(num_nodes);
+  // exact low degree edges not yet part of a forest
+  std::vector<Edge> exact;
+  if (low_degree != nullptr) low_degree->get_edges(exact);
   bool except = false;
   std::exception_ptr err;
   for (size_t t = 0; t < user_k; t++) {
+    auto boruvka_start = std::chrono::steady_clock::now();
     try {
       boruvka_emulation(true);
     } catch (...) {
       except = true;
       err = std::current_exception();
     }
+    query_phases.boruvka += seconds_since(boruvka_start);
     if (except) break;
 
+    // remove this forest from the sketches before finding the next one
+    auto result_start = std::chrono::steady_clock::now();
     for (node_id_t src = 0; src < num_nodes; src++) {
       for (node_id_t dst : spanning_forest[src]) {
         supernodes[src]->update(concat_pairing_fn(src, dst));
@@ -189,55 +1008,111 @@ std::vector<std::set<node_id_t>> GraphDistribUpdate::k_spanning_forests(node_id_
         adj_list[src].insert(dst);
       }
     }
+    // exact edges that join components of the sketch forest complete this forest
+    for (size_t i = 0; i < exact.size();) {
+      if (merge_components(exact[i].src, exact[i].dst)) {
+        adj_list[exact[i].src].insert(exact[i].dst);
+        exact[i] = exact.back();
+        exact.pop_back();
+      } else {
+        i++;
+      }
+    }
+    query_phases.result += seconds_since(result_start);
   }
 
   // get ready for ingesting more from the stream
   // reset dsu and resume graph workers
-  for (node_id_t i = 0; i < num_nodes; i++) {
-    supernodes[i]->reset_query_state();
-  }
-  update_locked = false;
-  WorkDistributor::unpause_workers();
+  resume_after_query();
+
+  // the DSU now describes the graph with the forests removed
+  dsu_valid = false;
+  dsu_snapshot.valid = false;
 
   // check if boruvka errored
   if (except) std::rethrow_exception(err);
 
+  kf_cache = adj_list;
+  kf_cache_k = user_k;
+  kf_snapshot = {true, snapshot_updates, flush_start};
+  query_state_version++;
+
   cc_alg_start = k_cc_start;
   cc_alg_end = std::chrono::steady_clock::now();
 
   return adj_list;
 }
 
-bool GraphDistribUpdate::point_to_point_query(node_id_t a, node_id_t b) {
+node_id_t GraphDistribUpdate::min_cut(QueryStaleness staleness, QueryPhases *phases) {
+  // a certificate per leader does not preserve the cuts of the graph
+  require_single_leader("min_cut()");
+  std::lock_guard<std::mutex> lk(query_lock);
+  PhasesOut phases_out(query_phases, phases);
+  // always ask for all k forests so that min_cut queries share the cached forests
+  CertificateGraph certificate(k_spanning_forests_locked(k, staleness));
+
+  // the cut on the certificate is part of computing the result
+  auto cut_start = std::chrono::steady_clock::now();
+  uint64_t cut = certificate.min_cut();
+  cc_alg_end = std::chrono::steady_clock::now();
+  query_phases.result += std::chrono::duration<double>(cc_alg_end - cut_start).count();
+
+  // cuts of size k or more are not preserved by the certificate
+  return cut < k ? cut : k;
+}
+
+bool GraphDistribUpdate::is_k_edge_connected(node_id_t user_k, QueryStaleness staleness,
+                                             QueryPhases *phases) {
+  if (user_k > k) {
+    throw std::invalid_argument("Requested k out of range 0 < k < " + std::to_string(k));
+  }
+  return min_cut(staleness, phases) >= user_k;
+}
+
+bool GraphDistribUpdate::point_to_point_query(node_id_t a, node_id_t b,
+    QueryStaleness staleness, QueryPhases *phases) {
+  require_single_leader("point_to_point_query()");
+  std::lock_guard<std::mutex> lk(query_lock);
+  PhasesOut phases_out(query_phases, phases);
+  query_phases = QueryPhases();
+
   // DSU check before calling force_flush()
-  if (dsu_valid) {
+  if (dsu_valid || is_fresh(dsu_snapshot, staleness)) {
     cc_alg_start = flush_start = flush_end = std::chrono::steady_clock::now();
     std::cout << "~ Used existing DSU" << std::endl;
 #ifdef VERIFY_SAMPLES_F
-    for (node_id_t src = 0; src < num_nodes; ++src) {
-      for (const auto& dst : spanning_forest[src]) {
-        verifier->verify_edge({src, dst});
+    if (dsu_valid) {
+      for (node_id_t src = 0; src < num_nodes; ++src) {
+        for (const auto& dst : spanning_forest[src]) {
+          verifier->verify_edge({src, dst});
+        }
       }
     }
 #endif
     bool retval = (get_parent(a) == get_parent(b));
     cc_alg_end = std::chrono::steady_clock::now();
+    query_phases.cached = true;
+    query_phases.result = std::chrono::duration<double>(cc_alg_end - cc_alg_start).count();
     return retval;
   }
 
-  flush_start = std::chrono::steady_clock::now();
-  gts->force_flush(); // flush everything in buffering system to make final updates
-  WorkDistributor::pause_workers(); // wait for the workers to finish applying the updates
-  flush_end = std::chrono::steady_clock::now();
-  // after this point all updates have been processed from the guttering system
+  uint64_t snapshot_updates = get_num_updates();
+  dsu_snapshot.valid = false;
+  flush_for_query();
 
   // if backing up in memory then perform copying in boruvka
   bool except = false;
   std::exception_ptr err;
   bool ret;
   try {
+    auto boruvka_start = std::chrono::steady_clock::now();
     boruvka_emulation(true);
+    auto result_start = std::chrono::steady_clock::now();
+    query_phases.boruvka = std::chrono::duration<double>(result_start - boruvka_start).count();
+    merge_low_degree_edges();
     ret = (get_parent(a) == get_parent(b));
+    query_phases.result = seconds_since(result_start);
+    dsu_snapshot = {true, snapshot_updates, flush_start};
   } catch (...) {
     except = true;
     err = std::current_exception();
@@ -245,11 +1120,7 @@ bool GraphDistribUpdate::point_to_point_query(node_id_t a, node_id_t b) {
 
   // get ready for ingesting more from the stream
   // reset dsu and resume graph workers
-  for (node_id_t i = 0; i < num_nodes; i++) {
-    supernodes[i]->reset_query_state();
-  }
-  update_locked = false;
-  WorkDistributor::unpause_workers();
+  resume_after_query();
 
   // check if boruvka errored
   if (except) std::rethrow_exception(err);
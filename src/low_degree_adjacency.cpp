@@ -0,0 +1,112 @@
+#include "low_degree_adjacency.h"
+
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+
+LowDegreeAdjacency::LowDegreeAdjacency(node_id_t num_nodes, size_t threshold)
+    : num_nodes(num_nodes), threshold(threshold) {
+  if (threshold == 0 || threshold > max_threshold)
+    throw std::invalid_argument("Low degree threshold must be in [1, " +
+                                std::to_string(max_threshold) + "]");
+  edges.resize((size_t)num_nodes * threshold);
+  state.resize(num_nodes, 0);
+  locks = new std::mutex[num_stripes];
+}
+
+LowDegreeAdjacency::~LowDegreeAdjacency() { delete[] locks; }
+
+bool LowDegreeAdjacency::remove(node_id_t v, node_id_t dst) {
+  uint8_t &count = state[v];
+  node_id_t *adj = slot(v);
+  for (size_t i = 0; i < count; i++) {
+    if (adj[i] == dst) {
+      adj[i] = adj[--count];
+      return true;
+    }
+  }
+  return false;
+}
+
+bool LowDegreeAdjacency::toggle(node_id_t a, node_id_t b, std::vector<Edge> &spill) {
+  if (a == b) return false;
+
+  while (true) {
+    node_id_t full;
+    {
+      // lock the stripes in order so that concurrent toggles cannot deadlock
+      size_t first = std::min(a % num_stripes, b % num_stripes);
+      size_t second = std::max(a % num_stripes, b % num_stripes);
+      std::lock_guard<std::mutex> lk_first(locks[first]);
+      std::unique_lock<std::mutex> lk_second(locks[second], std::defer_lock);
+      if (second != first) lk_second.lock();
+
+      if (is_promoted(a) || is_promoted(b)) return false;
+      // an update to an exact edge cancels it
+      if (remove(a, b)) {
+        remove(b, a);
+        return true;
+      }
+      if (state[a] < threshold && state[b] < threshold) {
+        slot(a)[state[a]++] = b;
+        slot(b)[state[b]++] = a;
+        return true;
+      }
+      full = state[a] < threshold ? b : a;
+    }
+    // too many edges for the exact representation, afterwards (a, b) goes to the sketches
+    promote(full, spill);
+  }
+}
+
+void LowDegreeAdjacency::promote(node_id_t v, std::vector<Edge> &spill) {
+  std::lock_guard<std::mutex> promote_lk(promote_lock);
+  std::vector<node_id_t> adj;
+  while (true) {
+    {
+      std::lock_guard<std::mutex> lk(locks[v % num_stripes]);
+      if (is_promoted(v)) return;
+      adj.assign(slot(v), slot(v) + state[v]);
+    }
+
+    // lock the stripes of v and its neighbors in order
+    std::vector<size_t> stripes{v % num_stripes};
+    for (node_id_t d : adj) stripes.push_back(d % num_stripes);
+    std::sort(stripes.begin(), stripes.end());
+    stripes.erase(std::unique(stripes.begin(), stripes.end()), stripes.end());
+    std::vector<std::unique_lock<std::mutex>> held;
+    held.reserve(stripes.size());
+    for (size_t s : stripes) held.emplace_back(locks[s]);
+
+    // a toggle may have changed the edges of v while it was unlocked
+    if (state[v] != adj.size() || !std::equal(adj.begin(), adj.end(), slot(v))) continue;
+
+    for (node_id_t d : adj) {
+      remove(d, v);
+      spill.push_back({v, d});
+    }
+    state[v] = promoted_state;
+    return;
+  }
+}
+
+void LowDegreeAdjacency::get_edges(std::vector<Edge> &out) const {
+  for (node_id_t v = 0; v < num_nodes; v++) {
+    if (is_promoted(v)) continue;
+    const node_id_t *adj = edges.data() + (size_t)v * threshold;
+    for (size_t i = 0; i < state[v]; i++) {
+      if (v < adj[i]) out.push_back({v, adj[i]});
+    }
+  }
+}
+
+void LowDegreeAdjacency::promote_all() {
+  std::fill(state.begin(), state.end(), promoted_state);
+}
+
+node_id_t LowDegreeAdjacency::get_num_promoted() const {
+  node_id_t promoted = 0;
+  for (node_id_t v = 0; v < num_nodes; v++)
+    promoted += is_promoted(v);
+  return promoted;
+}
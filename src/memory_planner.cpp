@@ -0,0 +1,169 @@
+#include "memory_planner.h"
+#include "msg_buffer_pool.h"
+#include "work_distributor.h"
+#include "worker_cluster.h"
+
+#include <mpi.h>
+#include <supernode.h>
+
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+#include <thread>
+
+// smallest parameters the planner will consider before rejecting a budget
+static constexpr double min_batch_factor = 0.05;
+static constexpr int min_buffer_exp = 16;
+
+// the Supernode configuration of the most recently constructed graph
+static bool graph_configured = false;
+static node_id_t graph_nodes;
+static node_id_t graph_k;
+
+void MemoryPlan::estimate(node_id_t num_nodes, int num_inserters, int num_workers) {
+  size_t supernode_size = Supernode::get_size();
+  size_t serialized_size = Supernode::get_serialized_size();
+  size_t gutter_size = batch_factor * serialized_size;
+
+  gutter_bytes = num_nodes * gutter_size;
+  work_queue_bytes = queue_factor * num_graph_workers * WorkerCluster::num_batches * gutter_size;
+#ifdef USE_STANDALONE
+  cache_tree_bytes = 0;
+#else
+  cache_tree_bytes = num_inserters * fanout * (size_t(1) << buffer_exp);
+#endif
+
+  // matches the batch size given to WorkerCluster::start_cluster()
+  max_msg_size = WorkerCluster::msg_size_for(
+      std::max(gutter_size / sizeof(node_id_t), serialized_size));
+  // message buffers come from a MsgBufferPool whose size classes round up by at most a quarter
+  size_t pooled_msg_size = MsgBufferPool::class_bytes(MsgBufferPool::class_of(max_msg_size));
+  size_t num_distributors = std::min(WorkerCluster::num_msg_forwarders, num_workers);
+  distributor_bytes = num_distributors * (2 * pooled_msg_size +
+      WorkDistributor::supernodes_per_distributor * supernode_size);
+  size_t workers_per_forwarder =
+      (num_workers + WorkerCluster::num_msg_forwarders - 1) / WorkerCluster::num_msg_forwarders;
+  forwarder_bytes = WorkerCluster::num_msg_forwarders * (workers_per_forwarder + 2) * pooled_msg_size;
+
+  // a handler releases its batches message before acquiring its delta message
+  handler_bytes = pooled_msg_size + WorkerCluster::num_batches * supernode_size;
+  worker_fixed_bytes = supernode_size;
+}
+
+MemoryPlan MemoryPlan::make(node_id_t num_nodes, node_id_t k, int num_inserters,
+                            const DistribConfiguration &conf) {
+  if (graph_configured && graph_nodes == num_nodes && graph_k == k)
+    return make_configured(num_nodes, k, num_inserters, conf);
+
+  // size the Supernodes for this plan, then restore the size the graph uses
+  struct RestoreConfiguration {
+    ~RestoreConfiguration() {
+      if (graph_configured)
+        Supernode::configure(graph_nodes, Supernode::default_num_columns, graph_k);
+    }
+  } restore;
+  Supernode::configure(num_nodes, Supernode::default_num_columns, k);
+  return make_configured(num_nodes, k, num_inserters, conf);
+}
+
+MemoryPlan MemoryPlan::make_for_graph(node_id_t num_nodes, node_id_t k, int num_inserters,
+                                      const DistribConfiguration &conf) {
+  // the Graph configures Supernodes identically when it is constructed
+  Supernode::configure(num_nodes, Supernode::default_num_columns, k);
+  graph_configured = true;
+  graph_nodes = num_nodes;
+  graph_k = k;
+  return make_configured(num_nodes, k, num_inserters, conf);
+}
+
+MemoryPlan MemoryPlan::make_configured(node_id_t num_nodes, node_id_t k, int num_inserters,
+                                       const DistribConfiguration &conf) {
+  int num_workers = 1;
+  int mpi_initialized;
+  MPI_Initialized(&mpi_initialized);
+  if (mpi_initialized) {
+    int total_processes;
+    MPI_Comm_size(WorkerCluster::get_comm(), &total_processes);
+    num_workers = std::max(total_processes - WorkerCluster::distrib_worker_offset, 1);
+  }
+
+  MemoryPlan plan;
+  plan.batch_factor = k > 1 ? 1.0 : 1.2;
+  plan.buffer_exp = 20;
+  plan.fanout = 64;
+  plan.num_flushers = 2;
+  plan.num_graph_workers = 1024;
+  plan.queue_factor = WorkerCluster::num_batches;
+  plan.worker_handlers = 0;
+
+  plan.sketch_bytes = num_nodes * Supernode::get_size();
+  plan.backup_bytes = conf._backup_in_mem ? plan.sketch_bytes : 0;
+  plan.low_degree_bytes = num_nodes * (conf._low_degree_threshold * sizeof(node_id_t) + 1);
+
+  if (!conf._use_budget) {
+    plan.estimate(num_nodes, num_inserters, num_workers);
+    return plan;
+  }
+
+  const ResourceBudget &budget = conf._budget;
+  unsigned leader_cores = budget.leader_cores;
+  if (leader_cores == 0) leader_cores = std::max(std::thread::hardware_concurrency(), 1u);
+  unsigned worker_cores = budget.worker_cores == 0 ? leader_cores : budget.worker_cores;
+  plan.num_flushers = leader_cores >= 32 ? 2 : 1;
+
+  // prefer large gutters, they produce large batches that are cheap to process
+  auto find_fit = [&]() {
+    for (; plan.batch_factor >= min_batch_factor; plan.batch_factor *= 0.8) {
+      for (plan.num_graph_workers = 1024; plan.num_graph_workers >= 1;
+           plan.num_graph_workers /= 2) {
+        for (plan.buffer_exp = 20; plan.buffer_exp >= min_buffer_exp; plan.buffer_exp--) {
+          plan.estimate(num_nodes, num_inserters, num_workers);
+          if (plan.leader_total() <= budget.leader_bytes) return true;
+        }
+      }
+    }
+    return false;
+  };
+  if (!find_fit()) {
+    throw std::invalid_argument("Leader memory budget of " +
+                                std::to_string(budget.leader_bytes / 1e9) +
+                                " GB is too small. Sketches alone require " +
+                                std::to_string((plan.sketch_bytes + plan.backup_bytes) / 1e9) +
+                                " GB");
+  }
+
+  // use up to two handlers per worker core as allowed by the worker's memory
+  size_t worker_avail = budget.worker_bytes > plan.worker_fixed_bytes
+                        ? budget.worker_bytes - plan.worker_fixed_bytes : 0;
+  plan.worker_handlers = std::min((size_t)2 * worker_cores, worker_avail / plan.handler_bytes);
+  if (plan.worker_handlers == 0) {
+    throw std::invalid_argument("Worker memory budget of " +
+                                std::to_string(budget.worker_bytes / 1e9) +
+                                " GB cannot hold a single batch handler of " +
+                                std::to_string(plan.handler_bytes / 1e9) + " GB");
+  }
+  return plan;
+}
+
+std::ostream &operator<<(std::ostream &out, const MemoryPlan &plan) {
+  out << "Memory Plan:" << std::endl;
+  out << " batch_factor = " << plan.batch_factor << ", buffer_exp = " << plan.buffer_exp
+      << ", fanout = " << plan.fanout << ", num_flushers = " << plan.num_flushers
+      << ", num_graph_workers = " << plan.num_graph_workers << std::endl;
+  out << " Leader (GB): sketches " << plan.sketch_bytes / 1e9
+      << ", query backup " << plan.backup_bytes / 1e9
+      << ", low degree " << plan.low_degree_bytes / 1e9
+      << ", gutters " << plan.gutter_bytes / 1e9
+      << ", cache tree " << plan.cache_tree_bytes / 1e9
+      << ", work queue " << plan.work_queue_bytes / 1e9
+      << ", distributors " << plan.distributor_bytes / 1e9
+      << ", forwarders " << plan.forwarder_bytes / 1e9
+      << ", total " << plan.leader_total() / 1e9 << std::endl;
+  out << " Worker (GB): message size " << plan.max_msg_size / 1e9
+      << ", per handler " << plan.handler_bytes / 1e9;
+  if (plan.worker_handlers == 0)
+    out << ", handlers 2 per core";
+  else
+    out << ", handlers " << plan.worker_handlers << ", total " << plan.worker_total() / 1e9;
+  return out;
+}
@@ -1,6 +1,9 @@
 #include "message_forwarders.h"
+#include "msg_buffer_pool.h"
+#include "trace_recorder.h"
 
 #include "mpi.h"
+#include <utility>
 
 
 /*******************************************************\
@@ -13,7 +16,7 @@ void BatchMessageForwarder::run() {
     msg_size = max_msg_size;
     int msg_src;
     // std::cout << "BatchMessageForwarder: " << id << " waiting for message ..." << std::endl;
-    MessageCode code = WorkerCluster::recv_message(msg_buffer, msg_size, msg_src);
+    MessageCode code = WorkerCluster::recv_pooled_message(msg_buffer, msg_size, msg_src);
     switch (code) {
       case BATCH:
         // The BatchMessageForwarder sends to one of the associated DistributedWorkers
@@ -38,6 +41,7 @@ void BatchMessageForwarder::run() {
 }
 
 void BatchMessageForwarder::send_batch() {
+  TRACE_SPAN("forward_batch", TraceRecorder::first_node(msg_buffer, msg_size));
   int which_buf;
   if (num_batch_sent < num_distrib) {
     which_buf = num_batch_sent;
@@ -50,25 +54,28 @@ void BatchMessageForwarder::send_batch() {
   }
 
   // std::cout << "BatchMessageForwarder: " << id << " sending to " << which_buf + distrib_offset << std::endl;
-  std::swap(msg_buffer, batch_msg_buffers[which_buf]);
+  // the previous message of this buffer has been sent so its buffer goes back to the pool
+  MsgBufferPool::get().release(batch_msg_buffers[which_buf]);
+  batch_msg_buffers[which_buf] = std::exchange(msg_buffer, nullptr);
   MPI_Isend(batch_msg_buffers[which_buf], msg_size, MPI_CHAR, which_buf + distrib_offset,
-            BATCH, MPI_COMM_WORLD, &batch_requests[which_buf]);
+            BATCH, WorkerCluster::comm, &batch_requests[which_buf]);
 }
 
 void BatchMessageForwarder::send_flush() {
   // std::cout << "BatchMessageForwarder: " << id << " sending flush to workers" << std::endl;
   for (int i = 0; i < num_distrib; i++) {
     int destination_id = i + distrib_offset;
-    MPI_Send(nullptr, 0, MPI_CHAR, destination_id, FLUSH, MPI_COMM_WORLD);
+    MPI_Send(nullptr, 0, MPI_CHAR, destination_id, FLUSH, WorkerCluster::comm);
   }
 }
 
 void BatchMessageForwarder::cleanup() {
-  delete[] msg_buffer;
+  MPI_Waitall(num_batch_sent, batch_requests, MPI_STATUSES_IGNORE);
   for (int i = 0; i < num_distrib; i++)
-    delete[] batch_msg_buffers[i];
+    MsgBufferPool::get().release(batch_msg_buffers[i]);
   delete[] batch_msg_buffers;
   delete[] batch_requests;
+  MsgBufferPool::get().trim();
 }
 
 void BatchMessageForwarder::init() {
@@ -87,7 +94,6 @@ void BatchMessageForwarder::init() {
 
   memcpy(&max_msg_size, init_buffer, sizeof(max_msg_size));
   memcpy(&WorkerCluster::num_workers, init_buffer + sizeof(max_msg_size), sizeof(WorkerCluster::num_workers));
-  msg_buffer = new char[max_msg_size];
 
   // calculate the number of DistributedWorkers we will communicate with
   int min = ceil((id-1) * (double)WorkerCluster::num_workers / WorkerCluster::num_msg_forwarders);
@@ -107,7 +113,7 @@ void BatchMessageForwarder::init() {
   batch_msg_buffers = new char*[num_distrib];
   batch_requests = new MPI_Request[num_distrib];
   for (int i = 0; i < num_distrib; i++)
-    batch_msg_buffers[i] = new char[max_msg_size];
+    batch_msg_buffers[i] = nullptr;
 
   num_batch_sent = 0;
 }
@@ -122,12 +128,15 @@ void DeltaMessageForwarder::run() {
     msg_size = max_msg_size;
     int msg_src;
     // std::cout << "DeltaMessageForwarder: " << id << " waiting for message ..." << std::endl;
-    MessageCode code = WorkerCluster::recv_message(msg_buffer, msg_size, msg_src);
+    MessageCode code = WorkerCluster::recv_pooled_message(msg_buffer, msg_size, msg_src);
     switch (code) {
       case DELTA:
         // The DeltaMessageForwarder sends to one of the associated DistributedWorkers
         send_delta();
         break;
+      case TELEMETRY:
+        send_telemetry();
+        break;
       case FLUSH:
         process_distrib_worker_done();
         break;
@@ -148,8 +157,17 @@ void DeltaMessageForwarder::run() {
 }
 
 void DeltaMessageForwarder::send_delta() {
+  TRACE_SPAN("forward_delta", TraceRecorder::first_node(msg_buffer, msg_size));
   // std::cout << "DeltaMessageForwarder " << id << " forwarding delta" << std::endl;
-  MPI_Send(msg_buffer, msg_size, MPI_CHAR, WorkerCluster::leader_proc, DELTA, MPI_COMM_WORLD);
+  MPI_Send(msg_buffer, msg_size, MPI_CHAR, WorkerCluster::leader_proc, DELTA,
+           WorkerCluster::comm);
+  MsgBufferPool::get().release(std::exchange(msg_buffer, nullptr));
+}
+
+void DeltaMessageForwarder::send_telemetry() {
+  MPI_Send(msg_buffer, msg_size, MPI_CHAR, WorkerCluster::leader_proc, TELEMETRY,
+           WorkerCluster::comm);
+  MsgBufferPool::get().release(std::exchange(msg_buffer, nullptr));
 }
 
 void DeltaMessageForwarder::process_distrib_worker_done() {
@@ -157,13 +175,13 @@ void DeltaMessageForwarder::process_distrib_worker_done() {
   // std::cout << "DeltaMessageForwarder " << id << " got flush from " << num_distrib_flushed << "/"
   //           << num_distrib << std::endl;
   if (num_distrib_flushed >= num_distrib) {
-    MPI_Send(nullptr, 0, MPI_CHAR, WorkerCluster::leader_proc, FLUSH, MPI_COMM_WORLD);
+    MPI_Send(nullptr, 0, MPI_CHAR, WorkerCluster::leader_proc, FLUSH, WorkerCluster::comm);
     num_distrib_flushed = 0;
   }
 }
 
 void DeltaMessageForwarder::cleanup() {
-  delete[] msg_buffer;
+  MsgBufferPool::get().trim();
 }
 
 void DeltaMessageForwarder::init() {
@@ -183,7 +201,6 @@ void DeltaMessageForwarder::init() {
   memcpy(&max_msg_size, init_buffer, sizeof(max_msg_size));
   memcpy(&WorkerCluster::num_workers, init_buffer + sizeof(max_msg_size),
          sizeof(WorkerCluster::num_workers));
-  msg_buffer = new char[max_msg_size];
 
   // calculate the number of DistributedWorkers we will communicate with
   int fid = WorkerCluster::delta_fwd_to_batch_fwd(id);
@@ -0,0 +1,114 @@
+#include "mmap_graph_stream.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <stdexcept>
+
+MmapGraphStream::MmapGraphStream(const std::string &file_name, size_t chunk_bytes)
+    : chunk_updates(std::max(chunk_bytes / update_size, (size_t) 1)) {
+  fd = open(file_name.c_str(), O_RDONLY);
+  if (fd < 0) {
+    throw std::runtime_error("Could not open stream " + file_name + ": " + strerror(errno));
+  }
+  struct stat file_stat;
+  if (fstat(fd, &file_stat) != 0) {
+    close(fd);
+    throw std::runtime_error("Could not stat stream " + file_name + ": " + strerror(errno));
+  }
+  file_bytes = file_stat.st_size;
+  if (file_bytes < header_size) {
+    close(fd);
+    throw std::runtime_error("Stream " + file_name + " is too short to hold its header");
+  }
+
+  void *mem = mmap(nullptr, file_bytes, PROT_READ, MAP_SHARED, fd, 0);
+  if (mem == MAP_FAILED) {
+    close(fd);
+    throw std::runtime_error("Could not map stream " + file_name + ": " + strerror(errno));
+  }
+  data = (char *) mem;
+  madvise(data, file_bytes, MADV_SEQUENTIAL);
+
+  std::memcpy(&num_nodes, data, sizeof(num_nodes));
+  std::memcpy(&num_edges, data + sizeof(num_nodes), sizeof(num_edges));
+  if ((file_bytes - header_size) / update_size < num_edges) {
+    munmap(data, file_bytes);
+    close(fd);
+    throw std::runtime_error("Stream " + file_name + " is truncated, its header claims " +
+                             std::to_string(num_edges) + " updates");
+  }
+  query_index = num_edges;
+}
+
+MmapGraphStream::~MmapGraphStream() {
+  munmap(data, file_bytes);
+  close(fd);
+}
+
+bool MmapGraphStream::claim(edge_id_t &first, edge_id_t &last) {
+  edge_id_t limit = query_index.load();
+  edge_id_t cur = next_update.load(std::memory_order_relaxed);
+  do {
+    if (cur >= limit) return false;
+    last = std::min(cur + chunk_updates, limit);
+  } while (!next_update.compare_exchange_weak(cur, last, std::memory_order_relaxed));
+  first = cur;
+  return true;
+}
+
+bool MmapGraphStream::advise(edge_id_t first, edge_id_t last, int advice) const {
+  static const uintptr_t page_size = sysconf(_SC_PAGESIZE);
+  uintptr_t start = (uintptr_t) update_ptr(first);
+  uintptr_t stop = (uintptr_t) update_ptr(last);
+  if (advice == MADV_DONTNEED) {
+    // only release pages entirely within the range, the others hold updates of other chunks
+    start = (start + page_size - 1) / page_size * page_size;
+    stop = stop / page_size * page_size;
+  } else {
+    start = start / page_size * page_size;
+    stop = (stop + page_size - 1) / page_size * page_size;
+  }
+  return start >= stop || madvise((void *) start, stop - start, advice) == 0;
+}
+
+bool MmapGraphStream::register_query(edge_id_t query_idx) {
+  if (query_idx > num_edges || query_idx <= next_update.load()) return false;
+  query_index = query_idx;
+  return true;
+}
+
+void MmapGraphStream::stream_reset() {
+  next_update = 0;
+  query_index = num_edges;
+}
+
+MmapStreamReader::~MmapStreamReader() {
+  if (chunk_last > chunk_first) stream.advise(chunk_first, chunk_last, MADV_DONTNEED);
+}
+
+bool MmapStreamReader::next_chunk() {
+  if (chunk_last > chunk_first) stream.advise(chunk_first, chunk_last, MADV_DONTNEED);
+  chunk_first = chunk_last = 0;
+  if (!stream.claim(chunk_first, chunk_last)) return false;
+
+  // Fault in the whole chunk with one call rather than a page fault per page. Kernels
+  // before 5.14 do not support MADV_POPULATE_READ, so fall back to a read ahead hint.
+  bool populated = false;
+#ifdef MADV_POPULATE_READ
+  populated = stream.advise(chunk_first, chunk_last, MADV_POPULATE_READ);
+#endif
+  if (!populated) stream.advise(chunk_first, chunk_last, MADV_WILLNEED);
+  // start reading the chunk that is likely to be claimed next
+  stream.advise(chunk_last, std::min(chunk_last + stream.chunk_updates, stream.num_edges),
+                MADV_WILLNEED);
+
+  pos = stream.update_ptr(chunk_first);
+  end = stream.update_ptr(chunk_last);
+  return true;
+}
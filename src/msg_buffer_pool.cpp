@@ -0,0 +1,136 @@
+#include "msg_buffer_pool.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <new>
+#include <stdexcept>
+#include <string>
+
+MsgBufferPool &MsgBufferPool::get() {
+  static MsgBufferPool pool;
+  return pool;
+}
+
+MsgBufferPool::ThreadCache &MsgBufferPool::thread_cache() {
+  // thread_local objects are destroyed before the pool at process exit
+  thread_local ThreadCache cache;
+  return cache;
+}
+
+MsgBufferPool::ThreadCache::ThreadCache() {
+  MsgBufferPool &pool = MsgBufferPool::get();
+  std::lock_guard<std::mutex> lk(pool.caches_lock);
+  pool.caches.push_back(this);
+}
+
+MsgBufferPool::ThreadCache::~ThreadCache() {
+  MsgBufferPool &pool = MsgBufferPool::get();
+  {
+    std::lock_guard<std::mutex> lk(pool.caches_lock);
+    pool.caches.erase(std::find(pool.caches.begin(), pool.caches.end(), this));
+  }
+  for (size_t c = 0; c < num_classes; c++) {
+    for (char *block : free_bufs[c])
+      pool.return_to_pool(c, block);
+  }
+}
+
+MsgBufferPool::~MsgBufferPool() { free_shared(); }
+
+size_t MsgBufferPool::class_of(size_t bytes) {
+  if (bytes <= (size_t(1) << min_class_log)) return 0;
+  size_t log = 63 - __builtin_clzll(bytes - 1); // 2^log <= bytes - 1 < 2^(log+1)
+  size_t sub = ((bytes - 1) >> (log - 2)) - classes_per_doubling;
+  return 1 + (log - min_class_log) * classes_per_doubling + sub;
+}
+
+size_t MsgBufferPool::class_bytes(size_t size_class) {
+  if (size_class == 0) return size_t(1) << min_class_log;
+  size_t log = min_class_log + (size_class - 1) / classes_per_doubling;
+  size_t sub = (size_class - 1) % classes_per_doubling;
+  return (classes_per_doubling + 1 + sub) << (log - 2);
+}
+
+char *MsgBufferPool::acquire(size_t bytes) {
+  size_t c = class_of(bytes);
+  if (c >= num_classes)
+    throw std::invalid_argument("MsgBufferPool: buffer of " + std::to_string(bytes) +
+                                " bytes is larger than the largest size class");
+
+  char *block = nullptr;
+  ThreadCache &cache = thread_cache();
+  {
+    std::lock_guard<std::mutex> cache_lk(cache.lock);
+    std::vector<char *> &cached = cache.free_bufs[c];
+    if (!cached.empty()) {
+      block = cached.back();
+      cached.pop_back();
+    }
+  }
+  if (block == nullptr) {
+    std::lock_guard<std::mutex> lk(locks[c]);
+    if (!free_lists[c].empty()) {
+      block = free_lists[c].back();
+      free_lists[c].pop_back();
+    }
+  }
+  if (block == nullptr) {
+    block = (char *) aligned_alloc(header_size, header_size + class_bytes(c));
+    if (block == nullptr) throw std::bad_alloc();
+    *(size_t *) block = c;
+    bytes_allocated += class_bytes(c);
+  }
+  bytes_in_use += class_bytes(c);
+  return block + header_size;
+}
+
+void MsgBufferPool::release(char *buf) {
+  if (buf == nullptr) return;
+  char *block = buf - header_size;
+  size_t c = *(size_t *) block;
+  bytes_in_use -= class_bytes(c);
+
+  ThreadCache &cache = thread_cache();
+  {
+    std::lock_guard<std::mutex> cache_lk(cache.lock);
+    std::vector<char *> &cached = cache.free_bufs[c];
+    if (cached.size() < thread_cache_size) {
+      cached.push_back(block);
+      return;
+    }
+  }
+  return_to_pool(c, block);
+}
+
+void MsgBufferPool::return_to_pool(size_t size_class, char *block) {
+  std::lock_guard<std::mutex> lk(locks[size_class]);
+  free_lists[size_class].push_back(block);
+}
+
+void MsgBufferPool::trim() {
+  {
+    // include the caches of idle threads, such as the OpenMP helpers between sessions
+    std::lock_guard<std::mutex> lk(caches_lock);
+    for (ThreadCache *cache : caches) {
+      std::lock_guard<std::mutex> cache_lk(cache->lock);
+      for (size_t c = 0; c < num_classes; c++) {
+        for (char *block : cache->free_bufs[c])
+          return_to_pool(c, block);
+        cache->free_bufs[c].clear();
+      }
+    }
+  }
+  free_shared();
+}
+
+void MsgBufferPool::free_shared() {
+  for (size_t c = 0; c < num_classes; c++) {
+    std::lock_guard<std::mutex> lk(locks[c]);
+    for (char *block : free_lists[c]) {
+      free(block);
+      bytes_allocated -= class_bytes(c);
+    }
+    free_lists[c].clear();
+    free_lists[c].shrink_to_fit();
+  }
+}
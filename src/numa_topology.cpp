@@ -0,0 +1,62 @@
+#include "numa_topology.h"
+
+#include <dirent.h>
+#include <sched.h>
+
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+#include <thread>
+
+NumaTopology::NumaTopology() {
+  std::vector<int> node_ids;
+  DIR *dir = opendir("/sys/devices/system/node");
+  if (dir != nullptr) {
+    while (dirent *entry = readdir(dir)) {
+      std::string name = entry->d_name;
+      if (name.compare(0, 4, "node") == 0 && name.size() > 4 &&
+          std::all_of(name.begin() + 4, name.end(), ::isdigit))
+        node_ids.push_back(std::atoi(name.c_str() + 4));
+    }
+    closedir(dir);
+  }
+  std::sort(node_ids.begin(), node_ids.end());
+
+  for (int id : node_ids) {
+    std::ifstream in("/sys/devices/system/node/node" + std::to_string(id) + "/cpulist");
+    std::string cpulist;
+    std::getline(in, cpulist);
+    std::vector<int> cpus = parse_cpulist(cpulist);
+    if (!cpus.empty()) node_cpus.push_back(cpus); // skip memory only nodes
+  }
+
+  if (node_cpus.empty()) {
+    std::vector<int> cpus(std::max(std::thread::hardware_concurrency(), 1u));
+    for (size_t i = 0; i < cpus.size(); i++) cpus[i] = i;
+    node_cpus.push_back(cpus);
+  }
+}
+
+std::vector<int> NumaTopology::parse_cpulist(const std::string &cpulist) {
+  std::vector<int> cpus;
+  std::stringstream ss(cpulist);
+  std::string range;
+  while (std::getline(ss, range, ',')) {
+    if (range.empty() || !isdigit(range[0])) continue;
+    size_t dash = range.find('-');
+    int first = std::atoi(range.c_str());
+    int last = dash == std::string::npos ? first : std::atoi(range.c_str() + dash + 1);
+    for (int cpu = first; cpu <= last; cpu++) cpus.push_back(cpu);
+  }
+  return cpus;
+}
+
+bool NumaTopology::pin_thread(size_t node) const {
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  for (int cpu : node_cpus[node])
+    if (cpu < CPU_SETSIZE) CPU_SET(cpu, &set);
+  return sched_setaffinity(0, sizeof(set), &set) == 0;
+}
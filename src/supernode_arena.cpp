@@ -0,0 +1,41 @@
+#include "supernode_arena.h"
+
+#include <sys/mman.h>
+#include <new>
+
+void SupernodeArena::reserve(size_t supernode_size, size_t _num_slots) {
+  slot_size = (supernode_size + slot_align - 1) / slot_align * slot_align;
+  num_slots = _num_slots;
+
+  size_t bytes = slot_size * num_slots;
+  if (bytes <= capacity) return; // reuse the existing mapping
+  release();
+
+  bytes = (bytes + huge_page_size - 1) / huge_page_size * huge_page_size;
+  void *mem = MAP_FAILED;
+#ifdef MAP_HUGETLB
+  mem = mmap(nullptr, bytes, PROT_READ | PROT_WRITE,
+             MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+  huge_pages = mem != MAP_FAILED;
+#endif
+  if (mem == MAP_FAILED) {
+    // no reserved huge pages so ask for transparent huge pages instead
+    mem = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (mem == MAP_FAILED) {
+      slot_size = num_slots = 0;
+      throw std::bad_alloc();
+    }
+#ifdef MADV_HUGEPAGE
+    huge_pages = madvise(mem, bytes, MADV_HUGEPAGE) == 0;
+#endif
+  }
+  base = (char *)mem;
+  capacity = bytes;
+}
+
+void SupernodeArena::release() {
+  if (base != nullptr) munmap(base, capacity);
+  base = nullptr;
+  capacity = 0;
+  huge_pages = false;
+}
@@ -0,0 +1,151 @@
+#include "trace_recorder.h"
+
+#include <mpi.h>
+
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <sstream>
+
+std::mutex TraceRecorder::rings_lock;
+std::vector<TraceRecorder::Ring *> TraceRecorder::rings;
+int64_t TraceRecorder::clock_offset_ns = 0;
+int TraceRecorder::rank = 0;
+std::string TraceRecorder::process_name;
+bool TraceRecorder::active = false;
+
+static constexpr int clock_rounds = 16; // ping-pongs per rank, the fastest round is used
+
+static uint64_t trace_now_ns() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+      std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+TraceRecorder::Ring &TraceRecorder::thread_ring() {
+  // rings outlive their threads so that their spans can be gathered at shutdown
+  thread_local Ring *ring = nullptr;
+  if (ring == nullptr) {
+    ring = new Ring();
+    std::lock_guard<std::mutex> lk(rings_lock);
+    ring->tid = rings.size();
+    rings.push_back(ring);
+  }
+  return *ring;
+}
+
+void TraceRecorder::record(const char *name, uint64_t start_ns, uint64_t end_ns, int64_t arg) {
+  if (!active) return;
+  Ring &ring = thread_ring();
+  uint64_t idx = ring.num_written.load(std::memory_order_relaxed);
+  ring.events[idx % ring_capacity] = {name, start_ns, end_ns - start_ns, arg};
+  ring.num_written.store(idx + 1, std::memory_order_release);
+}
+
+void TraceRecorder::align_clocks() {
+  int num_ranks;
+  MPI_Comm_size(MPI_COMM_WORLD, &num_ranks);
+  MPI_Comm clock_comm; // keeps the ping-pongs apart from cluster messages
+  MPI_Comm_dup(MPI_COMM_WORLD, &clock_comm);
+
+  if (rank == 0) {
+    clock_offset_ns = 0;
+    for (int r = 1; r < num_ranks; r++) {
+      for (int i = 0; i < clock_rounds; i++) {
+        MPI_Recv(nullptr, 0, MPI_CHAR, r, 0, clock_comm, MPI_STATUS_IGNORE);
+        uint64_t leader_ns = trace_now_ns();
+        MPI_Send(&leader_ns, sizeof(leader_ns), MPI_CHAR, r, 0, clock_comm);
+      }
+    }
+  } else {
+    uint64_t best_rtt = std::numeric_limits<uint64_t>::max();
+    for (int i = 0; i < clock_rounds; i++) {
+      uint64_t sent_ns = trace_now_ns();
+      MPI_Send(nullptr, 0, MPI_CHAR, 0, 0, clock_comm);
+      uint64_t leader_ns;
+      MPI_Recv(&leader_ns, sizeof(leader_ns), MPI_CHAR, 0, 0, clock_comm, MPI_STATUS_IGNORE);
+      uint64_t recv_ns = trace_now_ns();
+      // assume the leader read its clock halfway through the round trip
+      if (recv_ns - sent_ns < best_rtt) {
+        best_rtt = recv_ns - sent_ns;
+        clock_offset_ns = (int64_t) leader_ns - (int64_t) (sent_ns + best_rtt / 2);
+      }
+    }
+  }
+  MPI_Comm_free(&clock_comm);
+}
+
+void TraceRecorder::init(const std::string &name) {
+  MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+  process_name = name;
+  align_clocks();
+  active = true;
+}
+
+std::string TraceRecorder::serialize_events() {
+  std::ostringstream out;
+  out.precision(3);
+  out << std::fixed;
+  out << "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":" << rank
+      << ",\"args\":{\"name\":\"" << process_name << "\"}}";
+
+  std::lock_guard<std::mutex> lk(rings_lock);
+  for (Ring *ring : rings) {
+    uint64_t written = ring->num_written.load(std::memory_order_acquire);
+    uint64_t first = written > ring_capacity ? written - ring_capacity : 0;
+    for (uint64_t i = first; i < written; i++) {
+      const Event &event = ring->events[i % ring_capacity];
+      out << ",\n{\"name\":\"" << event.name << "\",\"ph\":\"X\",\"pid\":" << rank
+          << ",\"tid\":" << ring->tid
+          << ",\"ts\":" << ((int64_t) event.start_ns + clock_offset_ns) / 1e3
+          << ",\"dur\":" << event.dur_ns / 1e3;
+      if (event.arg >= 0) out << ",\"args\":{\"first_node\":" << event.arg << "}";
+      out << "}";
+    }
+  }
+  return out.str();
+}
+
+void TraceRecorder::finish(const std::string &trace_file) {
+  if (!active) return;
+  active = false;
+
+  std::string events = serialize_events();
+  int num_ranks;
+  MPI_Comm_size(MPI_COMM_WORLD, &num_ranks);
+  int size = events.size();
+  std::vector<int> sizes(num_ranks);
+  MPI_Gather(&size, 1, MPI_INT, sizes.data(), 1, MPI_INT, 0, MPI_COMM_WORLD);
+
+  std::vector<int> displs(num_ranks, 0);
+  std::vector<char> all_events;
+  if (rank == 0) {
+    for (int r = 1; r < num_ranks; r++) displs[r] = displs[r - 1] + sizes[r - 1];
+    all_events.resize(displs[num_ranks - 1] + sizes[num_ranks - 1]);
+  }
+  MPI_Gatherv(events.data(), size, MPI_CHAR, all_events.data(), sizes.data(), displs.data(),
+              MPI_CHAR, 0, MPI_COMM_WORLD);
+
+  if (rank == 0) {
+    std::ofstream out{trace_file, std::ios::trunc};
+    if (!out.is_open()) {
+      std::cerr << "ERROR: Could not open trace file " << trace_file << std::endl;
+    } else {
+      out << "{\"traceEvents\":[\n";
+      for (int r = 0; r < num_ranks; r++) {
+        if (r > 0) out << ",\n";
+        out.write(all_events.data() + displs[r], sizes[r]);
+      }
+      out << "\n]}\n";
+      std::cout << "Wrote trace of " << num_ranks << " processes to " << trace_file << std::endl;
+    }
+  }
+
+  std::lock_guard<std::mutex> lk(rings_lock);
+  for (Ring *ring : rings) ring->num_written = 0;
+}
+
+TraceSpan::TraceSpan(const char *name, int64_t arg)
+    : name(name), arg(arg), start_ns(trace_now_ns()) {}
+
+TraceSpan::~TraceSpan() { TraceRecorder::record(name, start_ns, trace_now_ns(), arg); }
@@ -1,7 +1,11 @@
 #include "work_distributor.h"
 #include "worker_cluster.h"
 #include "graph_distrib_update.h"
+#include "msg_buffer_pool.h"
+#include "cluster_metrics.h"
+#include "trace_recorder.h"
 
+#include <algorithm>
 #include <string>
 #include <iostream>
 #include <unistd.h>
@@ -14,30 +18,65 @@ bool WorkDistributor::paused   = false; // controls whether threads should pause
 constexpr size_t WorkDistributor::local_process_cutoff;
 int WorkDistributor::work_distrib_threads;
 node_id_t WorkDistributor::supernode_size;
+SupernodeArena WorkDistributor::supernode_arena;
+const NumaTopology *WorkDistributor::numa = nullptr;
 WorkDistributor **WorkDistributor::workers;
 std::condition_variable WorkDistributor::pause_condition;
 std::mutex WorkDistributor::pause_lock;
 std::thread WorkDistributor::status_thread;
 std::atomic<size_t> WorkDistributor::proc_locally;
+uint64_t WorkDistributor::session_start_ns;
+uint64_t WorkDistributor::pause_start_ns;
+uint64_t WorkDistributor::paused_ns;
+std::string WorkDistributor::bottleneck_file;
+BottleneckReport WorkDistributor::bottleneck_report;
+
+// Atomically replace path with the contents written by write_contents
+template <typename Writer>
+static void write_status_file(const std::string &path, Writer write_contents) {
+  std::string tmp_path = path + ".tmp";
+  std::ofstream tmp_file{tmp_path, std::ios::trunc};
+  if (!tmp_file.is_open()) {
+    std::cerr << "Could not open temporary status file " << tmp_path << std::endl;
+    return;
+  }
+  write_contents(tmp_file);
+  tmp_file.close();
+  if (std::rename(tmp_path.c_str(), path.c_str())) {
+    std::perror(("Error renaming " + tmp_path).c_str());
+  }
+}
+
+// With several leaders, possibly sharing a directory, each leader writes its
+// status files to path with _leader<id> inserted before the extension
+static std::string leader_path(const std::string &path) {
+  if (path.empty() || WorkerCluster::get_num_leaders() == 1) return path;
+  std::string suffix = "_leader" + std::to_string(WorkerCluster::get_leader_id());
+  size_t dot = path.rfind('.');
+  size_t slash = path.rfind('/');
+  if (dot == std::string::npos || (slash != std::string::npos && dot < slash))
+    return path + suffix;
+  return path.substr(0, dot) + suffix + path.substr(dot);
+}
 
-// Queries the work distributors for their current status and writes it to a file
-void status_querier() {
+// Queries the work distributors for their current status and writes it to
+// cluster_status.txt. Every second the status, the ClusterMetrics and the
+// memory report of the graph are also written to the graph's metrics file in
+// the Prometheus text format, unless it is empty.
+void status_querier(GraphDistribUpdate *graph) {
+  std::string metrics_file = leader_path(graph->get_metrics_file());
+  std::string status_file = leader_path("cluster_status.txt");
   auto start = std::chrono::steady_clock::now();
   double max_ingestion = 0.0;
   double cur_ingestion = 0.0;
   auto last_time = start;
   uint64_t last_insertions = 0;
   constexpr int interval_len = 10;
+  constexpr int metrics_interval = 5;
   int idx = 1;
+  int metrics_idx = 0;
 
   while(!WorkDistributor::is_shutdown()) {
-    // open temporary file
-    std::ofstream tmp_file{"cluster_status_tmp.txt", std::ios::trunc};
-    if (!tmp_file.is_open()) {
-      std::cerr << "Could not open cluster status temp file!" << std::endl;
-      return;
-    }
-
     // get status
     std::vector<std::pair<uint64_t, WorkerStatus>> status_vec = WorkDistributor::get_status();
     auto now = std::chrono::steady_clock::now();
@@ -69,21 +108,57 @@ void status_querier() {
     else idx++;
 
     // output status summary
-    tmp_file << "===== Cluster Status Summary =====" << std::endl;
-    tmp_file << "Number of Workers: " << status_vec.size() 
-             << "\t\tUptime: " << (uint64_t) total_time.count()
-             << " seconds" << std::endl;
-    tmp_file << "Estimated Overall Graph Update Rate: " << total_insertions / total_time.count() / 2 << std::endl;
-    tmp_file << "Current Graph Updates Rate: " << cur_ingestion << ", Max: " << max_ingestion << std::endl;
-    tmp_file << "QUEUE_WAIT         " << q_total << std::endl;
-    tmp_file << "DISTRIB_PROCESSING " << d_total << std::endl;
-    tmp_file << "APPLY_DELTA        " << a_total << std::endl;
-    tmp_file << "PAUSED             " << paused  << std::endl;
-
-    // rename temporary file to actual status file then sleep
-    tmp_file.flush();
-    if(std::rename("cluster_status_tmp.txt", "cluster_status.txt")) {
-      std::perror("Error renaming cluster status file");
+    write_status_file(status_file, [&](std::ostream &out) {
+      out << "===== Cluster Status Summary =====" << std::endl;
+      out << "Number of Workers: " << status_vec.size() 
+          << "\t\tUptime: " << (uint64_t) total_time.count()
+          << " seconds" << std::endl;
+      out << "Estimated Overall Graph Update Rate: " << total_insertions / total_time.count() / 2 << std::endl;
+      out << "Current Graph Updates Rate: " << cur_ingestion << ", Max: " << max_ingestion << std::endl;
+      out << "QUEUE_WAIT         " << q_total << std::endl;
+      out << "DISTRIB_PROCESSING " << d_total << std::endl;
+      out << "APPLY_DELTA        " << a_total << std::endl;
+      out << "PAUSED             " << paused  << std::endl;
+
+      // live view of the workers that have reported their activity
+      std::vector<WorkerTelemetry> reports = ClusterMetrics::get_telemetry();
+      if (!reports.empty()) {
+        double min_util = 1, max_util = 0, total_util = 0;
+        for (auto &report : reports) {
+          min_util = std::min(min_util, report.utilization);
+          max_util = std::max(max_util, report.utilization);
+          total_util += report.utilization;
+        }
+        out << "Worker Utilization: min " << min_util << ", mean " << total_util / reports.size()
+            << ", max " << max_util << " (" << reports.size() << " reporting)" << std::endl;
+        std::vector<int> stragglers = ClusterMetrics::get_stragglers();
+        out << "Slow Workers:      ";
+        if (stragglers.empty()) out << " none";
+        for (int worker : stragglers) out << " " << worker;
+        out << std::endl;
+      }
+    });
+
+    if (!metrics_file.empty() && metrics_idx++ % metrics_interval == 0) {
+      write_status_file(metrics_file, [&](std::ostream &out) {
+        out << "# HELP landscape_uptime_seconds Time since the WorkDistributors started\n";
+        out << "# TYPE landscape_uptime_seconds gauge\n";
+        out << "landscape_uptime_seconds " << total_time.count() << "\n";
+        out << "# HELP landscape_updates_total Graph updates processed by the WorkDistributors\n";
+        out << "# TYPE landscape_updates_total counter\n";
+        out << "landscape_updates_total " << total_insertions << "\n";
+        out << "# HELP landscape_local_updates_total Graph updates processed on the leader\n";
+        out << "# TYPE landscape_local_updates_total counter\n";
+        out << "landscape_local_updates_total " << WorkDistributor::get_proc_locally() << "\n";
+        out << "# HELP landscape_distributors WorkDistributors in each state\n";
+        out << "# TYPE landscape_distributors gauge\n";
+        out << "landscape_distributors{status=\"QUEUE_WAIT\"} " << q_total << "\n";
+        out << "landscape_distributors{status=\"DISTRIB_PROCESSING\"} " << d_total << "\n";
+        out << "landscape_distributors{status=\"APPLY_DELTA\"} " << a_total << "\n";
+        out << "landscape_distributors{status=\"PAUSED\"} " << paused << "\n";
+        ClusterMetrics::write_prometheus(out);
+        ClusterMetrics::write_leader_memory(out, graph->memory_report());
+      });
     }
     std::this_thread::sleep_for(std::chrono::milliseconds(200));
   }
@@ -98,20 +173,28 @@ void status_querier() {
 void WorkDistributor::start_workers(GraphDistribUpdate *_graph, GutteringSystem *_gts) {
   size_t buffer_size = std::max((size_t)_gts->gutter_size(), Supernode::get_serialized_size());
   WorkerCluster::start_cluster(_graph->get_num_nodes(), _graph->get_seed(), buffer_size,
-                               _graph->get_k());
+                               _graph->get_k(), _graph->get_memory_plan().worker_handlers);
   _gts->set_non_block(false); // make the WorkDistributors wait on queue
   shutdown = false;
   paused   = false;
   supernode_size = Supernode::get_size();
   work_distrib_threads = std::min(WorkerCluster::num_msg_forwarders, WorkerCluster::num_workers);
+  supernode_arena.reserve(supernode_size, work_distrib_threads * supernodes_per_distributor);
+  numa = _graph->get_numa_topology();
 
+  // WorkDistributor i sends to the batch forwarder of rank i within this leader's
+  // cluster, so each leader's updates only reach its own workers
   workers = new WorkDistributor*[work_distrib_threads];
   for (int i = 0; i < work_distrib_threads; i++) {
     // calculate number of workers this distributor is responsible for
     workers[i] = new WorkDistributor(i + 1, _graph, _gts);
   }
-  status_thread = std::thread(status_querier);
   proc_locally = 0;
+  ClusterMetrics::reset();
+  session_start_ns = ClusterMetrics::now_ns();
+  paused_ns = 0;
+  bottleneck_file = leader_path(_graph->get_bottleneck_file());
+  status_thread = std::thread(status_querier, _graph);
 }
 
 uint64_t WorkDistributor::stop_workers() {
@@ -127,6 +210,18 @@ uint64_t WorkDistributor::stop_workers() {
     delete workers[i];
   }
   delete[] workers;
+
+  // the workers have sent their final TELEMETRY before replying to the FLUSH
+  uint64_t end_ns = ClusterMetrics::now_ns();
+  if (paused) paused_ns += end_ns - pause_start_ns;
+  double active_seconds = (end_ns - session_start_ns - paused_ns) / 1e9;
+  bottleneck_report = ClusterMetrics::bottleneck_report(active_seconds, work_distrib_threads);
+  if (!bottleneck_file.empty()) {
+    write_status_file(bottleneck_file, [](std::ostream &out) {
+      bottleneck_report.write_json(out);
+    });
+  }
+
   if (WorkerCluster::is_active()) // catch edge case where stop after teardown_cluster()
     return WorkerCluster::stop_cluster() + proc_locally;
   else
@@ -134,6 +229,7 @@ uint64_t WorkDistributor::stop_workers() {
 }
 
 void WorkDistributor::pause_workers() {
+  pause_start_ns = ClusterMetrics::now_ns();
   paused = true;
   workers[0]->gts->set_non_block(true); // make the WorkDistributors bypass waiting in queue
 
@@ -163,6 +259,7 @@ void WorkDistributor::pause_workers() {
 
 void WorkDistributor::unpause_workers() {
   workers[0]->gts->set_non_block(false); // buffer-tree operations should block when necessary
+  paused_ns += ClusterMetrics::now_ns() - pause_start_ns;
   paused = false;
   pause_condition.notify_all();       // tell all paused workers to get back to work
 
@@ -191,13 +288,16 @@ void WorkDistributor::unpause_workers() {
 }
 
 WorkDistributor::WorkDistributor(int _id, GraphDistribUpdate *_graph, GutteringSystem *_gts)
-    : id(_id), graph(_graph), gts(_gts), num_updates(0), thr_paused(false), 
-      send_buf(new char[WorkerCluster::max_msg_size]), 
-      recv_buf(new char[WorkerCluster::max_msg_size]),
-      thr(start_send_worker, this), delta_thr(start_recv_worker, this) {
-  network_supernode = (Supernode *) malloc(Supernode::get_size());
+    : id(_id), numa_node(numa == nullptr ? -1 : (_id - 1) % numa->get_num_nodes()),
+      graph(_graph), gts(_gts), num_updates(0), thr_paused(false) {
+  size_t first_slot = (id - 1) * supernodes_per_distributor;
+  network_supernode = supernode_arena.get_slot(first_slot);
   for (size_t i = 0; i < num_helper_threads; i++)
-    local_supernodes[i] = (Supernode *) malloc(Supernode::get_size());
+    local_supernodes[i] = supernode_arena.get_slot(first_slot + 1 + i);
+
+  // start the threads once the scratch supernodes are assigned
+  thr = std::thread(start_send_worker, this);
+  delta_thr = std::thread(start_recv_worker, this);
 
   // std::cout << "Done initializing WorkDistributor: " << id << std::endl;
 }
@@ -205,14 +305,10 @@ WorkDistributor::WorkDistributor(int _id, GraphDistribUpdate *_graph, GutteringS
 WorkDistributor::~WorkDistributor() {
   thr.join();
   delta_thr.join();
-  free(network_supernode);
-  for (auto supernode : local_supernodes)
-    free(supernode);
-  delete[] send_buf;
-  delete[] recv_buf;
 }
 
 void WorkDistributor::do_send_work() {
+  pin_to_numa_node(); // helper threads created by this thread inherit its affinity
   WorkQueue::DataNode *data; // pointer to batches to send to worker
 
   while(true) {
@@ -220,11 +316,17 @@ void WorkDistributor::do_send_work() {
       distributor_status = QUEUE_WAIT;
       // call get_data which will handle waiting on the queue
       // and will enforce locking.
+      uint64_t wait_start = ClusterMetrics::now_ns();
       bool valid = gts->get_data(data);
       if (!valid && (shutdown || paused)) {
         break;
       }
       else if (!valid) continue;
+      uint64_t wait_end = ClusterMetrics::now_ns();
+      ClusterMetrics::record(GUTTER_WAIT, wait_end - wait_start);
+#ifdef LANDSCAPE_TRACE
+      TraceRecorder::record("gutter_wait", wait_start, wait_end, -1);
+#endif
 
       size_t upds_in_batches = 0;
       size_t num_batches = 0;
@@ -236,6 +338,7 @@ void WorkDistributor::do_send_work() {
 
       if (upds_in_batches < local_process_cutoff * num_batches) {
         distributor_status = DISTRIB_PROCESSING;
+        TRACE_SPAN("process_locally", -1);
         // process locally instead of sending over network
 #pragma omp parallel for num_threads(num_helper_threads)
         for (size_t i = 0; i < data->get_batches().size(); i++) {
@@ -258,14 +361,16 @@ void WorkDistributor::do_send_work() {
     if (shutdown) {
       // Tell the DistributedWorkers to flush their message queues and then shutdown
       // std::cout << "WorkDistributor: " << id << " send thread performing shutdown" << std::endl;
-      MPI_Send(nullptr, 0, MPI_CHAR, id, FLUSH, MPI_COMM_WORLD);
+      MPI_Send(nullptr, 0, MPI_CHAR, id, FLUSH, WorkerCluster::comm);
+      ClusterMetrics::count_sent(FLUSH, 0);
       return;
     }
     else if (paused) {
       // std::cout << "WorkDistributor: " << id << " send thread performing pause" << std::endl;
       
       // Tell the DistributedWorkers to flush their message queues and then pause
-      MPI_Send(nullptr, 0, MPI_CHAR, id, FLUSH, MPI_COMM_WORLD);
+      MPI_Send(nullptr, 0, MPI_CHAR, id, FLUSH, WorkerCluster::comm);
+      ClusterMetrics::count_sent(FLUSH, 0);
 
       // wait until we are unpaused
       std::unique_lock<std::mutex> lk(pause_lock);
@@ -282,21 +387,40 @@ void WorkDistributor::do_send_work() {
 void WorkDistributor::send_batches(WorkQueue::DataNode *data) {
   // std::cout << "WorkDistributor " << id << " sending batches to DistributedWorker" << std::endl;
   distributor_status = DISTRIB_PROCESSING;
-  WorkerCluster::send_batches(id, data->get_batches(), send_buf);
+  WorkerCluster::send_batches(id, data->get_batches());
 
   // add DataNodes back to work queue
   gts->get_data_callback(data);
 }
 
 void WorkDistributor::do_recv_work() {
+  pin_to_numa_node();
   int recv_from = WorkerCluster::batch_fwd_to_delta_fwd(id);
   while(true) {
     int msg_size = WorkerCluster::max_msg_size;
+    int msg_src;
+    char *recv_buf;
     // std::cout << "WorkDistributor: " << id << " recieving message from: " << recv_from << std::endl; 
-    MessageCode code = WorkerCluster::recv_message_from(recv_from, recv_buf, msg_size);
+    uint64_t recv_start = ClusterMetrics::now_ns();
+    MessageCode code = WorkerCluster::recv_pooled_message(recv_buf, msg_size, msg_src, recv_from);
+    // return the buffer to the pool however the message is handled, including by an exception
+    struct ReleaseOnExit {
+      char *buf;
+      ~ReleaseOnExit() { MsgBufferPool::get().release(buf); }
+    } release_recv{recv_buf};
     if (code == DELTA) {
       distributor_status = APPLY_DELTA;
+      uint64_t apply_start = ClusterMetrics::now_ns();
+      ClusterMetrics::record(DELTA_RECV, apply_start - recv_start);
+      TRACE_SPAN("apply_deltas", TraceRecorder::first_node(recv_buf, msg_size));
       WorkerCluster::parse_and_apply_deltas(recv_buf, msg_size, network_supernode, graph);
+      ClusterMetrics::record(DELTA_APPLY, ClusterMetrics::now_ns() - apply_start);
+    } else if (code == TELEMETRY) {
+      if (msg_size != sizeof(WorkerTelemetry))
+        throw BadMessageException("TELEMETRY message of wrong length");
+      WorkerTelemetry report;
+      memcpy(&report, recv_buf, sizeof(report));
+      ClusterMetrics::record_telemetry(report);
     } else if (code == FLUSH) {
       if (shutdown) {
         // std::cout << "WorkDistributor: " << id << " recv shutting down!" << std::endl;
@@ -1,6 +1,9 @@
 #include "worker_cluster.h"
 #include "work_distributor.h"
 #include "memstream.h"
+#include "msg_buffer_pool.h"
+#include "cluster_metrics.h"
+#include "trace_recorder.h"
 #include "message_forwarders.h"
 #include "graph_distrib_update.h"
 
@@ -13,16 +16,40 @@ int WorkerCluster::num_workers;
 uint64_t WorkerCluster::seed;
 int WorkerCluster::max_msg_size;
 bool WorkerCluster::active = false;
+MPI_Comm WorkerCluster::comm = MPI_COMM_WORLD;
+MPI_Comm WorkerCluster::leader_comm = MPI_COMM_NULL;
+int WorkerCluster::num_leaders = 1;
+int WorkerCluster::leader_id = 0;
 constexpr int WorkerCluster::num_msg_forwarders;
 
-int WorkerCluster::start_cluster(node_id_t n_nodes, uint64_t _seed, int batch_size,
-                                 double sketches_factor) {
+void WorkerCluster::split_leaders(int n_leaders) {
+  int world_size, world_rank;
+  MPI_Comm_size(MPI_COMM_WORLD, &world_size);
+  MPI_Comm_rank(MPI_COMM_WORLD, &world_rank);
+
+  // clusters of consecutive ranks whose sizes differ by at most one
+  num_leaders = n_leaders;
+  leader_id = (int64_t) world_rank * num_leaders / world_size;
+  MPI_Comm_split(MPI_COMM_WORLD, leader_id, world_rank, &comm);
+
+  int rank;
+  MPI_Comm_rank(comm, &rank);
+  MPI_Comm_split(MPI_COMM_WORLD, rank == leader_proc ? 0 : MPI_UNDEFINED, world_rank,
+                 &leader_comm);
+}
+
+void WorkerCluster::configure(node_id_t n_nodes, uint64_t _seed) {
   num_nodes = n_nodes;
   seed = _seed;
-  max_msg_size = (2*sizeof(node_id_t) + sizeof(node_id_t) * batch_size) * num_batches + sizeof(int);
+}
+
+int WorkerCluster::start_cluster(node_id_t n_nodes, uint64_t _seed, int batch_size,
+                                 double sketches_factor, int num_handlers) {
+  configure(n_nodes, _seed);
+  max_msg_size = msg_size_for(batch_size);
   active = true;
 
-  MPI_Comm_size(MPI_COMM_WORLD, &total_processes);
+  MPI_Comm_size(comm, &total_processes);
   num_workers = total_processes - distrib_worker_offset; // don't count msg forwarders and main
 
   // Initialize the MessageForwarders
@@ -32,19 +59,27 @@ int WorkerCluster::start_cluster(node_id_t n_nodes, uint64_t _seed, int batch_si
   memcpy(init_fwd + sizeof(max_msg_size), &num_workers, sizeof(num_workers));
   std::cout << "Number of Message Forwarders: " << distrib_worker_offset - 1 << std::endl;
   for (int i = 0; i < distrib_worker_offset - 1; i++)
-    MPI_Send(init_fwd, init_fwd_size, MPI_CHAR, i+1, INIT, MPI_COMM_WORLD);
+    MPI_Send(init_fwd, init_fwd_size, MPI_CHAR, i+1, INIT, comm);
 
   // Initialize the DistributedWorkers
   std::cout << "Number of workers is " << num_workers << ". Initializing!" << std::endl;
-  size_t init_size = sizeof(num_nodes) + sizeof(seed) + sizeof(max_msg_size) + sizeof(sketches_factor);
+  // the sizes to give mpi_experiment to measure this graph's messages
+  std::cout << "Largest BATCH message = " << max_msg_size << " bytes, DELTA message = "
+            << num_batches * (sizeof(node_id_t) + Supernode::get_serialized_size())
+               + delta_trailer_size
+            << " bytes" << std::endl;
+  size_t init_size = sizeof(num_nodes) + sizeof(seed) + sizeof(max_msg_size) +
+                     sizeof(sketches_factor) + sizeof(num_handlers);
   char init_data[init_size];
   memcpy(init_data, &num_nodes, sizeof(num_nodes));
   memcpy(init_data + sizeof(num_nodes), &seed, sizeof(seed));
   memcpy(init_data + sizeof(num_nodes) + sizeof(seed), &max_msg_size, sizeof(max_msg_size));
   memcpy(init_data + sizeof(num_nodes) + sizeof(seed) + sizeof(max_msg_size), &sketches_factor,
          sizeof(sketches_factor));
+  memcpy(init_data + sizeof(num_nodes) + sizeof(seed) + sizeof(max_msg_size) +
+         sizeof(sketches_factor), &num_handlers, sizeof(num_handlers));
   for (int i = 0; i < num_workers; i++)
-    MPI_Ssend(init_data, init_size, MPI_CHAR, i + distrib_worker_offset, INIT, MPI_COMM_WORLD);
+    MPI_Ssend(init_data, init_size, MPI_CHAR, i + distrib_worker_offset, INIT, comm);
 
   // std::cout << "Done initializing cluster" << std::endl;
   return num_workers;
@@ -54,15 +89,15 @@ uint64_t WorkerCluster::stop_cluster() {
   // std::cout << "STOPPING CLUSTER!" << std::endl;
   for (int i = 1; i < distrib_worker_offset; i++) {
     // send stop message to MessageForwarder
-    MPI_Send(nullptr, 0, MPI_CHAR, i, STOP, MPI_COMM_WORLD);
+    MPI_Send(nullptr, 0, MPI_CHAR, i, STOP, comm);
   }
 
   uint64_t total_updates = 0;
   for (int i = distrib_worker_offset; i < total_processes; i++) {
     // send stop message to worker i+1 (message is empty, just the STOP tag)
-    MPI_Send(nullptr, 0, MPI_CHAR, i, STOP, MPI_COMM_WORLD);
+    MPI_Send(nullptr, 0, MPI_CHAR, i, STOP, comm);
     uint64_t upds;
-    MPI_Recv(&upds, sizeof(uint64_t), MPI_CHAR, i, 0, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+    MPI_Recv(&upds, sizeof(uint64_t), MPI_CHAR, i, 0, comm, MPI_STATUS_IGNORE);
     total_updates += upds;
   }
   return total_updates;
@@ -72,20 +107,50 @@ void WorkerCluster::shutdown_cluster() {
   // std::cout << "SHUTTING DOWN CLUSTER!" << std::endl;
   for (int i = 1; i < total_processes; i++) {
     // send SHUTDOWN message to worker i+1 (message is empty, just the SHUTDOWN tag)
-    MPI_Send(nullptr, 0, MPI_CHAR, i, SHUTDOWN, MPI_COMM_WORLD);
+    MPI_Send(nullptr, 0, MPI_CHAR, i, SHUTDOWN, comm);
   }
   active = false;
 }
 
-void WorkerCluster::send_batches(int fid, const std::vector<update_batch> &batches,
- char *msg_buffer) {
-  node_id_t msg_bytes = 0;
-
+void WorkerCluster::send_batches(int fid, const std::vector<update_batch> &batches) {
   if (fid < 1 || fid > num_msg_forwarders) {
     throw BadMessageException("send_batches(): Bad process ID");
   }
 
-  for (auto batch : batches) {
+  // size the message buffer to the batches rather than the largest possible message
+  char *msg_buffer = MsgBufferPool::get().acquire(serialized_batches_size(batches));
+
+  uint64_t start = ClusterMetrics::now_ns();
+  size_t msg_bytes = serialize_batches(batches, msg_buffer);
+  uint64_t serialized = ClusterMetrics::now_ns();
+  ClusterMetrics::record(SERIALIZE, serialized - start);
+
+  // Send the message to the worker
+  MPI_Send(msg_buffer, msg_bytes, MPI_CHAR, fid, BATCH, comm);
+  uint64_t sent = ClusterMetrics::now_ns();
+  ClusterMetrics::record(SEND, sent - serialized);
+#ifdef LANDSCAPE_TRACE
+  int64_t first_node = TraceRecorder::first_node(msg_buffer, msg_bytes);
+  TraceRecorder::record("serialize_batches", start, serialized, first_node);
+  TraceRecorder::record("send_batches", serialized, sent, first_node);
+#endif
+  ClusterMetrics::count_sent(BATCH, msg_bytes);
+  MsgBufferPool::get().release(msg_buffer);
+}
+
+size_t WorkerCluster::serialized_batches_size(const std::vector<update_batch> &batches) {
+  size_t total_bytes = 0;
+  for (auto &batch : batches) {
+    if (batch.upd_vec.size() > 0)
+      total_bytes += (batch.upd_vec.size() + 2) * sizeof(node_id_t);
+  }
+  return total_bytes;
+}
+
+size_t WorkerCluster::serialize_batches(const std::vector<update_batch> &batches,
+                                        char *msg_buffer) {
+  size_t msg_bytes = 0;
+  for (auto &batch : batches) {
     if (batch.upd_vec.size() > 0) {
       // serialize batch to char *
       node_id_t node_idx = batch.node_idx;
@@ -100,12 +165,23 @@ void WorkerCluster::send_batches(int fid, const std::vector<update_batch> &batch
       msg_bytes += dests_size * sizeof(node_id_t) + 2 * sizeof(node_id_t);
     }
   }
-  // Send the message to the worker
-  MPI_Send(msg_buffer, msg_bytes, MPI_CHAR, fid, BATCH, MPI_COMM_WORLD);
+  return msg_bytes;
 }
 
 void WorkerCluster::parse_and_apply_deltas(char *msg_buffer, int msg_size, Supernode *delta,
                                            GraphDistribUpdate *graph) {
+  parse_and_apply_deltas(msg_buffer, msg_size, delta, graph->get_supernodes());
+}
+
+void WorkerCluster::parse_and_apply_deltas(char *msg_buffer, int msg_size, Supernode *delta,
+                                           Supernode *const *supernodes) {
+  if (msg_size < (int) delta_trailer_size)
+    throw BadMessageException("DELTA message is missing its trailer");
+  uint64_t compute_ns;
+  msg_size -= delta_trailer_size;
+  memcpy(&compute_ns, msg_buffer + msg_size, sizeof(compute_ns));
+  ClusterMetrics::record(REMOTE_COMPUTE, compute_ns);
+
   // parse the message into Supernodes
   imemstream msg_stream(msg_buffer, msg_size);
   for (node_id_t d = 0; d < WorkerCluster::num_batches && msg_stream.tellg() < msg_size; d++) {
@@ -113,13 +189,13 @@ void WorkerCluster::parse_and_apply_deltas(char *msg_buffer, int msg_size, Super
     node_id_t node_idx;
     msg_stream.read((char *) &node_idx, sizeof(node_id_t));
     Supernode::makeSupernode(num_nodes, seed, msg_stream, delta);
-    graph->get_supernode(node_idx)->apply_delta_update(delta);
+    supernodes[node_idx]->apply_delta_update(delta);
   }
 }
 
 MessageCode WorkerCluster::recv_message(char *msg_addr, int &msg_size, int &msg_src) {
   MPI_Status status;
-  MPI_Probe(MPI_ANY_SOURCE, MPI_ANY_TAG, MPI_COMM_WORLD, &status);
+  MPI_Probe(MPI_ANY_SOURCE, MPI_ANY_TAG, comm, &status);
   int temp_size;
   MPI_Get_count(&status, MPI_CHAR, &temp_size);
   // ensure the message is not too large for us to recieve
@@ -130,14 +206,14 @@ MessageCode WorkerCluster::recv_message(char *msg_addr, int &msg_size, int &msg_
   msg_src = status.MPI_SOURCE;
 
   // recieve the message and write it to the msg_addr
-  MPI_Recv(msg_addr, msg_size, MPI_CHAR, status.MPI_SOURCE, status.MPI_TAG, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+  MPI_Recv(msg_addr, msg_size, MPI_CHAR, status.MPI_SOURCE, status.MPI_TAG, comm, MPI_STATUS_IGNORE);
 
   return (MessageCode) status.MPI_TAG;
 }
 
 MessageCode WorkerCluster::recv_message_from(int source, char* msg_addr, int& msg_size) {
   MPI_Status status;
-  MPI_Probe(source, MPI_ANY_TAG, MPI_COMM_WORLD, &status);
+  MPI_Probe(source, MPI_ANY_TAG, comm, &status);
   int temp_size;
   MPI_Get_count(&status, MPI_CHAR, &temp_size);
   // ensure the message is not too large for us to recieve
@@ -147,7 +223,28 @@ MessageCode WorkerCluster::recv_message_from(int source, char* msg_addr, int& ms
   msg_size = temp_size;
 
   // recieve the message and write it to the msg_addr
-  MPI_Recv(msg_addr, msg_size, MPI_CHAR, status.MPI_SOURCE, status.MPI_TAG, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+  MPI_Recv(msg_addr, msg_size, MPI_CHAR, status.MPI_SOURCE, status.MPI_TAG, comm, MPI_STATUS_IGNORE);
+
+  return (MessageCode) status.MPI_TAG;
+}
+
+MessageCode WorkerCluster::recv_pooled_message(char *&msg_addr, int &msg_size, int &msg_src,
+                                               int source) {
+  MPI_Status status;
+  MPI_Probe(source, MPI_ANY_TAG, comm, &status);
+  int temp_size;
+  MPI_Get_count(&status, MPI_CHAR, &temp_size);
+  // ensure the message is not too large for us to recieve
+  if (temp_size > msg_size) {
+    throw BadMessageException("Size of recieved message is too large: " + std::to_string(temp_size));
+  }
+  msg_size = temp_size;
+  msg_src = status.MPI_SOURCE;
+  ClusterMetrics::count_recieved((MessageCode) status.MPI_TAG, msg_size);
+
+  // recieve the message into a buffer of its size class
+  msg_addr = msg_size > 0 ? MsgBufferPool::get().acquire(msg_size) : nullptr;
+  MPI_Recv(msg_addr, msg_size, MPI_CHAR, status.MPI_SOURCE, status.MPI_TAG, comm, MPI_STATUS_IGNORE);
 
   return (MessageCode) status.MPI_TAG;
 }
@@ -179,9 +276,9 @@ void WorkerCluster::serialize_delta(const node_id_t node_idx, Supernode &delta,
 }
 
 void WorkerCluster::return_deltas(int dst_id, char* delta_msg, size_t delta_msg_size) {
-  MPI_Send(delta_msg, delta_msg_size, MPI_CHAR, dst_id, DELTA, MPI_COMM_WORLD);
+  MPI_Send(delta_msg, delta_msg_size, MPI_CHAR, dst_id, DELTA, comm);
 }
 
 void WorkerCluster::send_upds_processed(uint64_t num_updates) {
-  MPI_Send(&num_updates, sizeof(uint64_t), MPI_CHAR, 0, 0, MPI_COMM_WORLD);
+  MPI_Send(&num_updates, sizeof(uint64_t), MPI_CHAR, leader_proc, 0, comm);
 }
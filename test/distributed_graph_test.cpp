@@ -4,6 +4,9 @@
 #include <mat_graph_verifier.h>
 #include <graph_gen.h>
 #include "work_distributor.h"
+#include "msg_buffer_pool.h"
+#include "cluster_metrics.h"
+#include "mmap_graph_stream.h"
 
 TEST(DistributedGraphTest, SmallRandomGraphs) {
   int num_trials = 5;
@@ -222,6 +225,380 @@ TEST(DistributedGraphTest, TestQueryDuringStream) {
   g.get_connected_components();
 }
 
+TEST(DistributedGraphTest, TestUpdateBatch) {
+  generate_stream({1024, 0.002, 0.5, 0, "./sample.txt", "./cumul_sample.txt"});
+  std::ifstream in{"./sample.txt"};
+  ASSERT_TRUE(in.is_open());
+  node_id_t n;
+  edge_id_t m;
+  in >> n >> m;
+  GraphDistribUpdate g(n, 1);
+  MatGraphVerifier verify(n);
+
+  int type;
+  node_id_t a, b;
+  std::vector<GraphUpdate> upds;
+  for (edge_id_t i = 0; i < m; i++) {
+    in >> type >> a >> b;
+    upds.push_back({{a, b}, (UpdateType)type});
+  }
+
+  // batches that are not a multiple of update_batch_chunk, with a query between them
+  size_t half = upds.size() / 2;
+  g.update_batch(upds.data(), half);
+  for (size_t i = 0; i < half; i++) verify.edge_update(upds[i].edge.src, upds[i].edge.dst);
+  verify.reset_cc_state();
+  g.set_verifier(std::make_unique<MatGraphVerifier>(verify));
+  g.get_connected_components(true);
+
+  g.update_batch(upds.data() + half, upds.size() - half);
+  for (size_t i = half; i < upds.size(); i++)
+    verify.edge_update(upds[i].edge.src, upds[i].edge.dst);
+  verify.reset_cc_state();
+  g.set_verifier(std::make_unique<MatGraphVerifier>(verify));
+  g.get_connected_components();
+  ASSERT_EQ(g.get_num_updates(), m);
+}
+
+TEST(DistributedGraphTest, TestDiskQueryBackup) {
+  generate_stream({1024, 0.002, 0.5, 0, "./sample.txt", "./cumul_sample.txt"});
+  std::ifstream in{"./sample.txt"};
+  ASSERT_TRUE(in.is_open());
+  node_id_t n;
+  edge_id_t m;
+  in >> n >> m;
+  GraphDistribUpdate g(n, 1, 1, DistribConfiguration().backup_in_mem(false).backup_dir("."));
+  MatGraphVerifier verify(n);
+
+  int type;
+  node_id_t a, b;
+  edge_id_t half = m / 2;
+  for (edge_id_t i = 0; i < half; i++) {
+    in >> type >> a >> b;
+    g.update({{a,b}, (UpdateType)type});
+    verify.edge_update(a, b);
+  }
+  verify.reset_cc_state();
+  g.set_verifier(std::make_unique<MatGraphVerifier>(verify));
+  g.get_connected_components(true);
+
+  // the sketches restored from disk must give the correct answer at the end of the stream
+  m -= half;
+  while(m--) {
+    in >> type >> a >> b;
+    g.update({{a,b}, (UpdateType)type});
+    verify.edge_update(a, b);
+  }
+  verify.reset_cc_state();
+  g.set_verifier(std::make_unique<MatGraphVerifier>(verify));
+  g.get_connected_components();
+}
+
+TEST(DistributedGraphTest, TestLowDegreeHybrid) {
+  generate_stream({1024, 0.01, 0.5, 0, "./sample.txt", "./cumul_sample.txt"});
+  std::ifstream in{"./sample.txt"};
+  ASSERT_TRUE(in.is_open());
+  node_id_t n;
+  edge_id_t m;
+  in >> n >> m;
+  // a threshold below the average degree so that both representations are used
+  GraphDistribUpdate g(n, 1, 1, DistribConfiguration().low_degree_threshold(4));
+  MatGraphVerifier verify(n);
+
+  // the exact edges are not checked by the verifier, so count the components here
+  std::set<std::pair<node_id_t, node_id_t>> edges;
+  auto num_components = [&]() {
+    std::vector<node_id_t> parent(n);
+    for (node_id_t i = 0; i < n; i++) parent[i] = i;
+    std::function<node_id_t(node_id_t)> find = [&](node_id_t v) {
+      return parent[v] == v ? v : parent[v] = find(parent[v]);
+    };
+    size_t components = n;
+    for (auto &e : edges) {
+      node_id_t a = find(e.first), b = find(e.second);
+      if (a != b) {
+        parent[a] = b;
+        components--;
+      }
+    }
+    return components;
+  };
+
+  int type;
+  node_id_t a, b;
+  edge_id_t half = m / 2;
+  for (edge_id_t i = 0; i < half; i++) {
+    in >> type >> a >> b;
+    g.update({{a,b}, (UpdateType)type});
+    verify.edge_update(a, b);
+    auto e = std::make_pair(std::min(a, b), std::max(a, b));
+    if (!edges.erase(e)) edges.insert(e);
+  }
+  verify.reset_cc_state();
+  g.set_verifier(std::make_unique<MatGraphVerifier>(verify));
+  ASSERT_EQ(g.get_connected_components(true).size(), num_components());
+
+  m -= half;
+  while(m--) {
+    in >> type >> a >> b;
+    g.update({{a,b}, (UpdateType)type});
+    verify.edge_update(a, b);
+    auto e = std::make_pair(std::min(a, b), std::max(a, b));
+    if (!edges.erase(e)) edges.insert(e);
+  }
+  verify.reset_cc_state();
+  g.set_verifier(std::make_unique<MatGraphVerifier>(verify));
+  ASSERT_EQ(g.get_connected_components().size(), num_components());
+}
+
+TEST(DistributedGraphTest, TestCheckpointRestore) {
+  generate_stream({1024, 0.002, 0.5, 0, "./sample.txt", "./cumul_sample.txt"});
+  std::ifstream in{"./sample.txt"};
+  ASSERT_TRUE(in.is_open());
+  node_id_t n;
+  edge_id_t m;
+  in >> n >> m;
+  MatGraphVerifier verify(n);
+  size_t num_cc;
+  uint64_t seed;
+  {
+    GraphDistribUpdate g(n, 1);
+    int type;
+    node_id_t a, b;
+    while (m--) {
+      in >> type >> a >> b;
+      g.update({{a,b}, (UpdateType)type});
+      verify.edge_update(a, b);
+    }
+    g.checkpoint("./test_checkpoint.data");
+    verify.reset_cc_state();
+    g.set_verifier(std::make_unique<MatGraphVerifier>(verify));
+    num_cc = g.get_connected_components(true).size();
+    seed = g.get_seed();
+  }
+
+  // the restored graph must answer queries without replaying the stream
+  GraphDistribUpdate restored("./test_checkpoint.data", 1);
+  ASSERT_EQ(restored.get_num_nodes(), n);
+  ASSERT_EQ(restored.get_seed(), seed);
+  restored.set_verifier(std::make_unique<MatGraphVerifier>(verify));
+  ASSERT_EQ(restored.get_connected_components().size(), num_cc);
+}
+
+TEST(DistributedGraphTest, TestMemoryPlan) {
+  // without a budget the default parameters are used
+  MemoryPlan def = MemoryPlan::make(1 << 16, 1, 4, DistribConfiguration());
+  ASSERT_EQ(def.buffer_exp, 20);
+  ASSERT_EQ(def.worker_handlers, 0);
+
+  // a generous budget does not need to shrink anything
+  ResourceBudget large{size_t(1) << 40, size_t(1) << 40, 16, 8};
+  MemoryPlan big = MemoryPlan::make(1 << 16, 1, 4, DistribConfiguration().memory_budget(large));
+  ASSERT_EQ(big.batch_factor, def.batch_factor);
+  ASSERT_EQ(big.worker_handlers, 16);
+
+  // a tighter budget must be respected
+  ResourceBudget tight{def.sketch_bytes * 3, size_t(1) << 30, 16, 8};
+  MemoryPlan small = MemoryPlan::make(1 << 16, 1, 4, DistribConfiguration().memory_budget(tight));
+  ASSERT_LE(small.leader_total(), tight.leader_bytes);
+
+  // a budget that cannot hold the sketches is rejected
+  ResourceBudget tiny{def.sketch_bytes, size_t(1) << 30, 16, 8};
+  ASSERT_THROW(MemoryPlan::make(1 << 16, 1, 4, DistribConfiguration().memory_budget(tiny)),
+               std::invalid_argument);
+
+  // a graph constructed with a budget runs with the planned parameters
+  GraphDistribUpdate g(1024, 1, 1, DistribConfiguration().memory_budget(
+      {size_t(1) << 32, size_t(1) << 30, 4, 4}));
+  ASSERT_EQ(g.get_memory_plan().worker_handlers, 8);
+
+  // planning another graph leaves the supernodes sized for this one
+  size_t supernode_size = Supernode::get_size();
+  MemoryPlan::make(1 << 16, 2, 4, DistribConfiguration());
+  ASSERT_EQ(Supernode::get_size(), supernode_size);
+  g.update({{1, 2}, INSERT});
+  MatGraphVerifier verify(1024);
+  verify.edge_update(1, 2);
+  verify.reset_cc_state();
+  g.set_verifier(std::make_unique<MatGraphVerifier>(verify));
+  ASSERT_EQ(g.get_connected_components().size(), 1023);
+}
+
+TEST(DistributedGraphTest, TestNumaAware) {
+  GraphDistribUpdate g(1024, 1, 1, DistribConfiguration().numa_aware(true));
+  ASSERT_NE(g.get_numa_topology(), nullptr);
+  ASSERT_GE(g.get_numa_topology()->get_num_nodes(), 1);
+
+  MatGraphVerifier verify(1024);
+  for (node_id_t i = 0; i < 1023; i += 2) {
+    g.update({{i, i + 1}, INSERT});
+    verify.edge_update(i, i + 1);
+  }
+  verify.reset_cc_state();
+  g.set_verifier(std::make_unique<MatGraphVerifier>(verify));
+  ASSERT_EQ(g.get_connected_components().size(), 512);
+}
+
+TEST(DistributedGraphTest, TestMsgBufferPool) {
+  // size classes hold their sizes and waste at most a quarter of a buffer
+  for (size_t bytes = 1; bytes < (size_t(1) << 30); bytes = bytes * 1.1 + 1) {
+    size_t c = MsgBufferPool::class_of(bytes);
+    ASSERT_GE(MsgBufferPool::class_bytes(c), bytes);
+    if (c > 0) {
+      ASSERT_LE(MsgBufferPool::class_bytes(c), bytes + bytes / 4);
+    }
+  }
+
+  // released buffers are reused by any thread
+  MsgBufferPool &pool = MsgBufferPool::get();
+  size_t in_use = pool.get_bytes_in_use();
+  std::vector<std::thread> threads;
+  for (int t = 0; t < 4; t++) {
+    threads.emplace_back([&pool, t]() {
+      for (int i = 0; i < 1000; i++) {
+        size_t bytes = (i * 7919 + t) % 100000 + 1;
+        char *buf = pool.acquire(bytes);
+        memset(buf, t, bytes);
+        pool.release(buf);
+      }
+    });
+  }
+  for (auto &thr : threads) thr.join();
+  ASSERT_EQ(pool.get_bytes_in_use(), in_use);
+  ASSERT_THROW(pool.acquire(size_t(1) << 40), std::invalid_argument);
+
+  // trim() frees the buffers cached by threads that are still alive
+  std::promise<void> released, trimmed;
+  std::thread idle([&]() {
+    pool.release(pool.acquire(1 << 20));
+    released.set_value();
+    trimmed.get_future().wait();
+  });
+  released.get_future().wait();
+  pool.trim();
+  ASSERT_EQ(pool.get_bytes_allocated(), pool.get_bytes_in_use());
+  trimmed.set_value();
+  idle.join();
+
+  // the cluster sends and recieves through the pool
+  GraphDistribUpdate g(1024, 1);
+  MatGraphVerifier verify(1024);
+  for (node_id_t i = 0; i < 1023; i++) {
+    g.update({{i, i + 1}, INSERT});
+    verify.edge_update(i, i + 1);
+  }
+  verify.reset_cc_state();
+  g.set_verifier(std::make_unique<MatGraphVerifier>(verify));
+  ASSERT_EQ(g.get_connected_components().size(), 1);
+}
+
+TEST(DistributedGraphTest, TestClusterMetrics) {
+  std::remove("./test_metrics.prom");
+  GraphDistribUpdate g(1024, 1, 1, DistribConfiguration().metrics_file("./test_metrics.prom"));
+  MatGraphVerifier verify(1024);
+  for (node_id_t i = 0; i < 1023; i++) {
+    g.update({{i, i + 1}, INSERT});
+    verify.edge_update(i, i + 1);
+  }
+  verify.reset_cc_state();
+  g.set_verifier(std::make_unique<MatGraphVerifier>(verify));
+  ASSERT_EQ(g.get_connected_components().size(), 1);
+  ASSERT_GT(ClusterMetrics::get_histogram(GUTTER_WAIT).get_count(), 0);
+
+  // histogram buckets hold their values to within an eighth
+  LatencyHistogram hist;
+  for (uint64_t ns = 1; ns <= 1000; ns++) hist.record(ns * 1000);
+  ASSERT_EQ(hist.get_count(), 1000);
+  ASSERT_EQ(hist.get_max(), 1000000);
+  ASSERT_GE(hist.percentile(0.5), 500000);
+  ASSERT_LE(hist.percentile(0.5), 500000 + 500000 / 8);
+  ASSERT_EQ(hist.count_below(1 << 20), 1000);
+
+  // the metrics file is written when the WorkDistributors start
+  std::ifstream metrics{"./test_metrics.prom"};
+  ASSERT_TRUE(metrics.is_open());
+  std::string line;
+  bool found_stage = false;
+  while (std::getline(metrics, line))
+    found_stage |= line.find("landscape_stage_latency_seconds_count{stage=\"gutter_wait\"}") == 0;
+  ASSERT_TRUE(found_stage);
+}
+
+TEST(DistributedGraphTest, TestWorkerTelemetry) {
+  GraphDistribUpdate g(1024, 1);
+  MatGraphVerifier verify(1024);
+  for (node_id_t i = 0; i < 1023; i++) {
+    g.update({{i, i + 1}, INSERT});
+    verify.edge_update(i, i + 1);
+  }
+  verify.reset_cc_state();
+  g.set_verifier(std::make_unique<MatGraphVerifier>(verify));
+  ASSERT_EQ(g.get_connected_components().size(), 1);
+
+  // every worker reports before replying to the flush of the query
+  std::vector<WorkerTelemetry> reports = ClusterMetrics::get_telemetry();
+  ASSERT_GT(reports.size(), 0);
+  for (auto &report : reports) {
+    ASSERT_GE(report.worker_id, WorkerCluster::distrib_worker_offset);
+    ASSERT_GE(report.utilization, 0);
+    ASSERT_LE(report.utilization, 1);
+    ASSERT_EQ(report.pending_deltas, 0);
+    ASSERT_GT(report.memory_bytes, 0);
+    ASSERT_EQ(report.memory.report().total(), report.memory_bytes);
+    ASSERT_GT(report.memory.arena_bytes, 0);
+    ASSERT_GT(report.memory.handler_bytes, 0);
+  }
+}
+
+TEST(DistributedGraphTest, TestMemoryReport) {
+  GraphDistribUpdate g(1024, 1);
+  for (node_id_t i = 0; i < 1023; i++) g.update({{i, i + 1}, INSERT});
+  size_t state_before = 0;
+  for (auto &component : g.memory_report().components) {
+    if (std::string(component.name) == "query state") state_before = component.bytes;
+  }
+  ASSERT_GT(state_before, 0);
+  ASSERT_EQ(g.get_connected_components(true).size(), 1);
+
+  MemoryReport report = g.memory_report();
+  size_t sum = 0;
+  for (auto &component : report.components) {
+    sum += component.bytes;
+    if (std::string(component.name) == "supernodes") {
+      ASSERT_EQ(component.bytes, 1024 * Supernode::get_size());
+    }
+    if (std::string(component.name) == "query state") {
+      ASSERT_GT(component.bytes, state_before); // the spanning forest has 1023 edges
+    }
+  }
+  ASSERT_EQ(report.total(), sum);
+}
+
+TEST(DistributedGraphTest, TestBottleneckReport) {
+  std::remove("./test_bottleneck.json");
+  {
+    GraphDistribUpdate g(1024, 1, 1, DistribConfiguration().bottleneck_file("./test_bottleneck.json"));
+    for (node_id_t i = 0; i < 1023; i++) g.update({{i, i + 1}, INSERT});
+    ASSERT_EQ(g.get_connected_components().size(), 1);
+  }
+
+  // the report is made when the WorkDistributors stop
+  const BottleneckReport &report = WorkDistributor::get_bottleneck_report();
+  ASSERT_GT(report.seconds, 0);
+  ASSERT_EQ(report.stages.size(), 6);
+  ASSERT_GE(report.bottleneck, 0);
+  for (auto &stage : report.stages) {
+    ASSERT_LE(stage.busy, 1);
+    ASSERT_LE(stage.idle, 1);
+  }
+  std::ifstream json{"./test_bottleneck.json"};
+  ASSERT_TRUE(json.is_open());
+  std::string line;
+  std::getline(json, line);
+  ASSERT_NE(line.find("\"bottleneck\": \"" + std::string(report.stages[report.bottleneck].name)),
+            std::string::npos);
+}
+
 TEST(DistributedGraphTest, TestFewBatches) {
   GraphDistribUpdate g(1024, 1);
   MatGraphVerifier verify(1024);
@@ -245,3 +622,194 @@ TEST(DistributedGraphTest, TestFewBatches) {
   g.set_verifier(std::make_unique<MatGraphVerifier>(verify));
   ASSERT_EQ(g.get_connected_components().size(), 1022);
 }
+
+TEST(DistributedGraphTest, TestLeaderRange) {
+  // the tests run with a single leader, which owns every node
+  ASSERT_EQ(WorkerCluster::get_num_leaders(), 1);
+  node_id_t n = 1000;
+  GraphDistribUpdate g(n, 1);
+  ASSERT_EQ(g.get_leader_range(), std::make_pair((node_id_t) 0, n));
+  ASSERT_EQ(WorkerCluster::leader_first_node(1, n), n);
+  for (node_id_t v = 0; v < n; v++) ASSERT_EQ(WorkerCluster::leader_of(v, n), 0);
+
+  // the components need no merge across leaders
+  g.update({{1, 2}, INSERT});
+  g.update({{2, 3}, INSERT});
+  ASSERT_EQ(g.get_connected_components().size(), n - 2);
+}
+
+TEST(DistributedGraphTest, TestStaleQueryCache) {
+  GraphDistribUpdate g(1024, 1);
+  MatGraphVerifier verify(1024);
+
+  g.update({{1, 2}, INSERT});
+  verify.edge_update(1, 2);
+  verify.reset_cc_state();
+  g.set_verifier(std::make_unique<MatGraphVerifier>(verify));
+  ASSERT_EQ(g.get_connected_components(true).size(), 1023);
+
+  // a query allowed to miss one update may answer without this edge
+  g.update({{2, 3}, INSERT});
+  verify.edge_update(2, 3);
+  QueryStaleness one_update{1, std::chrono::milliseconds(0)};
+  ASSERT_EQ(g.get_connected_components(true, one_update).size(), 1023);
+  ASSERT_FALSE(g.point_to_point_query(1, 3, one_update));
+
+  // an exact query must include it
+  verify.reset_cc_state();
+  g.set_verifier(std::make_unique<MatGraphVerifier>(verify));
+  ASSERT_EQ(g.get_connected_components(true).size(), 1022);
+  ASSERT_TRUE(g.point_to_point_query(1, 3));
+}
+
+TEST(DistributedGraphTest, TestQueryPhases) {
+  GraphDistribUpdate g(1024, 1);
+  for (node_id_t i = 0; i < 1023; i++) g.update({{i, i + 1}, INSERT});
+
+  QueryPhases phases;
+  ASSERT_TRUE(g.point_to_point_query(0, 1023, QueryStaleness(), &phases));
+  ASSERT_FALSE(phases.cached);
+  ASSERT_GT(phases.flush, 0);
+  ASSERT_GT(phases.pause, 0);
+  ASSERT_GT(phases.boruvka, 0);
+  ASSERT_GT(phases.reset, 0);
+  double sum = 0;
+  for (int p = 0; p < QueryPhases::num_phases; p++) sum += phases.get(p);
+  ASSERT_DOUBLE_EQ(sum, phases.total());
+
+  // without new updates the DSU answers the query and only the result is timed
+  ASSERT_EQ(g.get_connected_components(true, QueryStaleness(), &phases).size(), 1);
+  ASSERT_TRUE(phases.cached);
+  ASSERT_EQ(phases.flush, 0);
+  ASSERT_EQ(phases.boruvka, 0);
+  ASSERT_EQ(phases.unpause, 0);
+}
+
+TEST(DistributedGraphTest, TestAsyncQueries) {
+  generate_stream({1024, 0.002, 0.5, 0, "./sample.txt", "./cumul_sample.txt"});
+  std::ifstream in{"./sample.txt"};
+  ASSERT_TRUE(in.is_open());
+  node_id_t n;
+  edge_id_t m;
+  in >> n >> m;
+  GraphDistribUpdate g(n, 1);
+  MatGraphVerifier verify(n);
+
+  int type;
+  node_id_t a, b;
+  while (m--) {
+    in >> type >> a >> b;
+    g.update({{a, b}, (UpdateType)type});
+    verify.edge_update(a, b);
+  }
+  verify.reset_cc_state();
+  g.set_verifier(std::make_unique<MatGraphVerifier>(verify));
+
+  auto cc_future = g.submit_cc_query();
+  auto point_future = g.submit_point_query(0, 1);
+  std::vector<std::set<node_id_t>> cc = cc_future.get();
+  bool connected = point_future.get();
+
+  bool expected = false;
+  for (auto &component : cc) {
+    if (component.count(0) > 0) expected = component.count(1) > 0;
+  }
+  ASSERT_EQ(connected, expected);
+}
+
+TEST(DistributedGraphTest, TestPeriodicSnapshots) {
+  generate_stream({1024, 0.002, 0.5, 0, "./sample.txt", "./cumul_sample.txt"});
+  std::ifstream in{"./sample.txt"};
+  ASSERT_TRUE(in.is_open());
+  node_id_t n;
+  edge_id_t m;
+  in >> n >> m;
+  GraphDistribUpdate g(n, 1);
+  g.set_verifier(std::make_unique<FileGraphVerifier>(n, "./cumul_sample.txt"));
+
+  // take a single snapshot once the entire stream has been inserted
+  std::mutex lock;
+  std::condition_variable cond;
+  size_t num_snapshots = 0;
+  size_t num_cc = 0;
+  g.start_snapshots(m, std::chrono::milliseconds(0), [&](const ConnectivitySnapshot &snapshot) {
+    std::lock_guard<std::mutex> lk(lock);
+    num_snapshots++;
+    num_cc = snapshot.components.size();
+    cond.notify_all();
+  });
+
+  int type;
+  node_id_t a, b;
+  while (m--) {
+    in >> type >> a >> b;
+    g.update({{a, b}, (UpdateType)type});
+  }
+
+  std::unique_lock<std::mutex> lk(lock);
+  ASSERT_TRUE(cond.wait_for(lk, std::chrono::seconds(60), [&]{ return num_snapshots > 0; }));
+  lk.unlock();
+  g.stop_snapshots();
+  ASSERT_EQ(num_snapshots, 1);
+  ASSERT_EQ(num_cc, g.get_connected_components(true).size());
+}
+
+TEST(DistributedGraphTest, TestMmapGraphStream) {
+  // update i of the stream is (i, i + 1)
+  const std::string file = "./test_mmap_stream.data";
+  node_id_t num_nodes = 1 << 16;
+  edge_id_t num_updates = 100000;
+  {
+    std::ofstream out{file, std::ios::binary | std::ios::trunc};
+    out.write((const char *) &num_nodes, sizeof(num_nodes));
+    out.write((const char *) &num_updates, sizeof(num_updates));
+    for (node_id_t i = 0; i < num_updates; i++) {
+      uint8_t type = i % 2 == 0 ? INSERT : DELETE;
+      node_id_t dst = i + 1;
+      out.write((const char *) &type, sizeof(type));
+      out.write((const char *) &i, sizeof(i));
+      out.write((const char *) &dst, sizeof(dst));
+    }
+  }
+
+  // small chunks so that the readers interleave
+  MmapGraphStream stream(file, 9 * 1000);
+  ASSERT_EQ(stream.nodes(), num_nodes);
+  ASSERT_EQ(stream.edges(), num_updates);
+
+  constexpr int num_threads = 4;
+  std::vector<std::atomic<int>> seen(num_updates);
+  std::atomic<edge_id_t> num_read{0};
+  auto read_until_breakpoint = [&]() {
+    std::vector<std::thread> threads;
+    for (int t = 0; t < num_threads; t++) {
+      threads.emplace_back([&]() {
+        MmapStreamReader reader(stream);
+        while (true) {
+          GraphUpdate upd = reader.get_edge();
+          if (upd.type == BREAKPOINT) return;
+          ASSERT_EQ(upd.edge.dst, upd.edge.src + 1);
+          ASSERT_EQ(upd.type, upd.edge.src % 2 == 0 ? INSERT : DELETE);
+          seen[upd.edge.src]++;
+          num_read++;
+        }
+      });
+    }
+    for (auto &thread : threads) thread.join();
+  };
+
+  ASSERT_TRUE(stream.register_query(12345));
+  read_until_breakpoint();
+  ASSERT_EQ(num_read, 12345);
+  ASSERT_FALSE(stream.register_query(12345)); // already read
+
+  stream.post_query_resume();
+  read_until_breakpoint();
+  ASSERT_EQ(num_read, num_updates);
+  for (edge_id_t i = 0; i < num_updates; i++) ASSERT_EQ(seen[i], 1);
+
+  stream.stream_reset();
+  read_until_breakpoint();
+  ASSERT_EQ(num_read, 2 * num_updates);
+  std::remove(file.c_str());
+}
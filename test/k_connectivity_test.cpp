@@ -1,5 +1,6 @@
 #include <gtest/gtest.h>
 #include "graph_distrib_update.h"
+#include "certificate_graph.h"
 #include <file_graph_verifier.h>
 #include <mat_graph_verifier.h>
 
@@ -28,3 +29,45 @@ TEST(KConnectivityTest, SimpleTest) {
   }
   std::cout << "number of spanning forest edges: " << edges << std::endl;
 }
+
+TEST(KConnectivityTest, CertificateMinCut) {
+  // a cycle has a min cut of 2
+  std::vector<std::set<node_id_t>> cycle(1000);
+  for (node_id_t i = 0; i < 1000; i++)
+    cycle[i].insert((i + 1) % 1000);
+  ASSERT_EQ(CertificateGraph(cycle).min_cut(), 2);
+
+  // two triangles joined by a single edge
+  std::vector<std::set<node_id_t>> bridge = {{1, 2}, {2}, {3}, {4, 5}, {5}, {}};
+  ASSERT_EQ(CertificateGraph(bridge).min_cut(), 1);
+
+  // a disconnected graph
+  std::vector<std::set<node_id_t>> disconnected = {{1}, {}, {3}, {}};
+  ASSERT_EQ(CertificateGraph(disconnected).min_cut(), 0);
+
+  // the complete graph on 5 vertices
+  std::vector<std::set<node_id_t>> complete(5);
+  for (node_id_t i = 0; i < 5; i++)
+    for (node_id_t j = i + 1; j < 5; j++)
+      complete[i].insert(j);
+  ASSERT_EQ(CertificateGraph(complete).min_cut(), 4);
+}
+
+TEST(KConnectivityTest, MinCutQuery) {
+  node_id_t num_nodes = 1024;
+  GraphDistribUpdate g{num_nodes, 1, 3};
+  MatGraphVerifier verify(num_nodes);
+  for (node_id_t i = 0; i < num_nodes; i++) {
+    g.update({{i, (i + 1) % num_nodes}, INSERT});
+    verify.edge_update(i, (i + 1) % num_nodes);
+  }
+  verify.reset_cc_state();
+  g.set_verifier(std::make_unique<MatGraphVerifier>(verify));
+
+  // the cycle is 2 but not 3 edge connected
+  QueryPhases phases;
+  ASSERT_EQ(g.min_cut(QueryStaleness(), &phases), 2);
+  ASSERT_GT(phases.result, 0); // includes the cut on the certificate
+  ASSERT_TRUE(g.is_k_edge_connected(2));
+  ASSERT_FALSE(g.is_k_edge_connected(3));
+}
@@ -0,0 +1,238 @@
+#include "benchmark/benchmark.h"
+
+#include <cstdio>
+#include <fstream>
+#include <random>
+#include <thread>
+
+#include <supernode.h>
+#include "worker_cluster.h"
+#include "memstream.h"
+#include "mmap_graph_stream.h"
+#include "msg_buffer_pool.h"
+#include "msg_buffer_queue.h"
+
+/*
+ * Microbenchmarks of the message paths between the leader and the workers.
+ * None of them send a message, so they run as a single process without mpirun.
+ * Run with --benchmark_format=json (or --benchmark_out=<file>) to track them
+ * across releases.
+ */
+
+constexpr uint64_t seed = 437650290;
+
+// WorkerCluster::num_batches batches of batch_size random updates to nodes below num_nodes
+static std::vector<update_batch> make_batches(node_id_t num_nodes, size_t batch_size) {
+  std::mt19937_64 gen(seed);
+  std::uniform_int_distribution<node_id_t> node(0, num_nodes - 1);
+  std::vector<update_batch> batches(WorkerCluster::num_batches);
+  for (auto &batch : batches) {
+    batch.node_idx = node(gen);
+    for (size_t i = 0; i < batch_size; i++) batch.upd_vec.push_back(node(gen));
+  }
+  return batches;
+}
+
+// Supernodes of num_nodes with a few updates applied so their sketches are not empty
+static std::vector<Supernode *> make_supernodes(node_id_t num_nodes, size_t count) {
+  WorkerCluster::configure(num_nodes, seed);
+  Supernode::configure(num_nodes);
+  std::vector<Supernode *> supernodes;
+  for (size_t i = 0; i < count; i++) {
+    Supernode *supernode = Supernode::makeSupernode(num_nodes, seed);
+    for (node_id_t j = 1; j < 16; j++)
+      supernode->update(concat_pairing_fn(i % num_nodes, (i + j) % num_nodes));
+    supernodes.push_back(supernode);
+  }
+  return supernodes;
+}
+
+static void free_supernodes(std::vector<Supernode *> &supernodes) {
+  for (Supernode *supernode : supernodes) free(supernode);
+}
+
+// args: updates per batch, number of graph nodes
+static void batch_args(benchmark::internal::Benchmark *bench) {
+  for (int64_t batch_size : {16, 256, 4096})
+    for (int64_t num_nodes : {1 << 10, 1 << 17})
+      bench->Args({batch_size, num_nodes});
+}
+
+// Serialize the batches of a BATCH message on the leader
+static void BM_SerializeBatches(benchmark::State &state) {
+  std::vector<update_batch> batches = make_batches(state.range(1), state.range(0));
+  size_t msg_bytes = WorkerCluster::serialized_batches_size(batches);
+  char *msg_buffer = MsgBufferPool::get().acquire(msg_bytes);
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(WorkerCluster::serialize_batches(batches, msg_buffer));
+    benchmark::ClobberMemory();
+  }
+  MsgBufferPool::get().release(msg_buffer);
+  state.SetBytesProcessed(state.iterations() * msg_bytes);
+  state.SetItemsProcessed(state.iterations() * state.range(0) * WorkerCluster::num_batches);
+}
+BENCHMARK(BM_SerializeBatches)->Apply(batch_args);
+
+// Parse a BATCH message on a worker
+static void BM_ParseBatches(benchmark::State &state) {
+  std::vector<update_batch> batches = make_batches(state.range(1), state.range(0));
+  size_t msg_bytes = WorkerCluster::serialized_batches_size(batches);
+  char *msg_buffer = MsgBufferPool::get().acquire(msg_bytes);
+  WorkerCluster::serialize_batches(batches, msg_buffer);
+  for (auto _ : state) {
+    std::vector<batch_t> parsed;
+    WorkerCluster::parse_batches(msg_buffer, msg_bytes, parsed);
+    benchmark::DoNotOptimize(parsed.data());
+  }
+  MsgBufferPool::get().release(msg_buffer);
+  state.SetBytesProcessed(state.iterations() * msg_bytes);
+  state.SetItemsProcessed(state.iterations() * state.range(0) * WorkerCluster::num_batches);
+}
+BENCHMARK(BM_ParseBatches)->Apply(batch_args);
+
+// Serialize the deltas of a DELTA message on a worker. arg: number of graph nodes
+static void BM_SerializeDelta(benchmark::State &state) {
+  std::vector<Supernode *> deltas = make_supernodes(state.range(0), WorkerCluster::num_batches);
+  size_t msg_bytes = deltas.size() * (sizeof(node_id_t) + Supernode::get_serialized_size());
+  char *msg_buffer = MsgBufferPool::get().acquire(msg_bytes);
+  for (auto _ : state) {
+    omemstream stream(msg_buffer, msg_bytes);
+    for (size_t i = 0; i < deltas.size(); i++)
+      WorkerCluster::serialize_delta(i, *deltas[i], stream);
+    benchmark::ClobberMemory();
+  }
+  MsgBufferPool::get().release(msg_buffer);
+  free_supernodes(deltas);
+  state.SetBytesProcessed(state.iterations() * msg_bytes);
+  state.SetItemsProcessed(state.iterations() * WorkerCluster::num_batches);
+}
+BENCHMARK(BM_SerializeDelta)->RangeMultiplier(8)->Range(1 << 10, 1 << 19);
+
+// Parse a DELTA message and apply its deltas on the leader. arg: number of graph nodes
+static void BM_ParseAndApplyDeltas(benchmark::State &state) {
+  node_id_t num_nodes = state.range(0);
+  std::vector<Supernode *> deltas = make_supernodes(num_nodes, WorkerCluster::num_batches);
+  std::vector<Supernode *> supernodes = make_supernodes(num_nodes, WorkerCluster::num_batches);
+  size_t msg_bytes = deltas.size() * (sizeof(node_id_t) + Supernode::get_serialized_size())
+                     + WorkerCluster::delta_trailer_size;
+  char *msg_buffer = MsgBufferPool::get().acquire(msg_bytes);
+  omemstream stream(msg_buffer, msg_bytes);
+  for (size_t i = 0; i < deltas.size(); i++)
+    WorkerCluster::serialize_delta(i, *deltas[i], stream);
+  uint64_t compute_ns = 0;
+  stream.write((const char *) &compute_ns, sizeof(compute_ns));
+  Supernode *delta = (Supernode *) malloc(Supernode::get_size());
+
+  for (auto _ : state) {
+    WorkerCluster::parse_and_apply_deltas(msg_buffer, stream.tellp(), delta, supernodes.data());
+    benchmark::ClobberMemory();
+  }
+  free(delta);
+  MsgBufferPool::get().release(msg_buffer);
+  free_supernodes(deltas);
+  free_supernodes(supernodes);
+  state.SetBytesProcessed(state.iterations() * msg_bytes);
+  state.SetItemsProcessed(state.iterations() * WorkerCluster::num_batches);
+}
+BENCHMARK(BM_ParseAndApplyDeltas)->RangeMultiplier(8)->Range(1 << 10, 1 << 19);
+
+// Helper threads push to a MsgBufferQueue while one thread pops, as on a worker.
+// arg: number of pushing threads
+static void BM_MsgBufferQueue(benchmark::State &state) {
+  constexpr size_t pushes_per_thread = 1 << 14;
+  size_t num_pushers = state.range(0);
+  std::vector<MsgBufferQueue<int>::QueueElm *> elms;
+  for (size_t i = 0; i < num_pushers * pushes_per_thread; i++) {
+    int data = i;
+    elms.push_back(new MsgBufferQueue<int>::QueueElm(data));
+  }
+
+  for (auto _ : state) {
+    MsgBufferQueue<int> queue;
+    std::vector<std::thread> pushers;
+    for (size_t t = 0; t < num_pushers; t++) {
+      pushers.emplace_back([&, t]() {
+        for (size_t i = 0; i < pushes_per_thread; i++)
+          queue.push(elms[t * pushes_per_thread + i]);
+      });
+    }
+    for (size_t i = 0; i < elms.size(); i++) benchmark::DoNotOptimize(queue.pop());
+    for (auto &pusher : pushers) pusher.join();
+  }
+  for (auto elm : elms) delete elm;
+  state.SetItemsProcessed(state.iterations() * elms.size());
+}
+BENCHMARK(BM_MsgBufferQueue)->RangeMultiplier(2)->Range(1, 16)->UseRealTime();
+
+// Write a buffer through an omemstream in chunks. arg: bytes per write
+static void BM_OMemstream(benchmark::State &state) {
+  constexpr size_t buffer_bytes = 1 << 20;
+  std::vector<char> buffer(buffer_bytes);
+  std::vector<char> chunk(state.range(0), 'x');
+  for (auto _ : state) {
+    omemstream stream(buffer.data(), buffer_bytes);
+    for (size_t written = 0; written + chunk.size() <= buffer_bytes; written += chunk.size())
+      stream.write(chunk.data(), chunk.size());
+    benchmark::ClobberMemory();
+  }
+  state.SetBytesProcessed(state.iterations() * (buffer_bytes - buffer_bytes % chunk.size()));
+}
+BENCHMARK(BM_OMemstream)->RangeMultiplier(8)->Range(8, 1 << 15);
+
+// Read a buffer through an imemstream in chunks. arg: bytes per read
+static void BM_IMemstream(benchmark::State &state) {
+  constexpr size_t buffer_bytes = 1 << 20;
+  std::vector<char> buffer(buffer_bytes, 'x');
+  std::vector<char> chunk(state.range(0));
+  for (auto _ : state) {
+    imemstream stream(buffer.data(), buffer_bytes);
+    for (size_t read = 0; read + chunk.size() <= buffer_bytes; read += chunk.size())
+      stream.read(chunk.data(), chunk.size());
+    benchmark::DoNotOptimize(chunk.data());
+  }
+  state.SetBytesProcessed(state.iterations() * (buffer_bytes - buffer_bytes % chunk.size()));
+}
+BENCHMARK(BM_IMemstream)->RangeMultiplier(8)->Range(8, 1 << 15);
+
+// Inserter threads reading a binary stream through an MmapGraphStream. arg: number of threads
+static void BM_MmapStreamReader(benchmark::State &state) {
+  const std::string file = "./landscape_bench_stream.data";
+  constexpr node_id_t num_nodes = 1 << 17;
+  constexpr edge_id_t num_updates = 1 << 23;
+  {
+    std::ofstream out{file, std::ios::binary | std::ios::trunc};
+    out.write((const char *) &num_nodes, sizeof(num_nodes));
+    out.write((const char *) &num_updates, sizeof(num_updates));
+    std::mt19937_64 gen(seed);
+    std::uniform_int_distribution<node_id_t> node(0, num_nodes - 1);
+    for (edge_id_t i = 0; i < num_updates; i++) {
+      uint8_t type = INSERT;
+      node_id_t src = node(gen), dst = node(gen);
+      out.write((const char *) &type, sizeof(type));
+      out.write((const char *) &src, sizeof(src));
+      out.write((const char *) &dst, sizeof(dst));
+    }
+  }
+
+  MmapGraphStream stream(file);
+  for (auto _ : state) {
+    stream.stream_reset();
+    std::vector<std::thread> readers;
+    for (int64_t t = 0; t < state.range(0); t++) {
+      readers.emplace_back([&]() {
+        MmapStreamReader reader(stream);
+        node_id_t sum = 0;
+        for (GraphUpdate upd = reader.get_edge(); upd.type != BREAKPOINT; upd = reader.get_edge())
+          sum += upd.edge.src ^ upd.edge.dst;
+        benchmark::DoNotOptimize(sum);
+      });
+    }
+    for (auto &reader : readers) reader.join();
+  }
+  std::remove(file.c_str());
+  state.SetBytesProcessed(state.iterations() * num_updates * 9);
+  state.SetItemsProcessed(state.iterations() * num_updates);
+}
+BENCHMARK(BM_MmapStreamReader)->RangeMultiplier(4)->Range(1, 64)->UseRealTime();
+
+BENCHMARK_MAIN();
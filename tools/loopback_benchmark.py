@@ -0,0 +1,187 @@
+"""
+Runs the full Landscape pipeline (leader, message forwarders and workers) on
+a single machine with mpirun --oversubscribe. It sweeps over worker counts,
+inserter threads and batches per message, and reports throughput, final
+flush latency and CPU time per rank. The stream comes from the deterministic
+SimpleStream generator of speed_expr, so no dataset or cluster is required.
+
+The number of batches per message is fixed at compile time. Each value is
+built in its own directory with -DLANDSCAPE_NUM_BATCHES.
+
+Example, from the repository root:
+  python3 tools/loopback_benchmark.py --workers 1 2 4 --inserters 1 4 --num_batches 16 32
+"""
+import argparse
+import csv
+import json
+import os
+import re
+import subprocess
+import sys
+import time
+
+num_forwarders = 10
+distrib_worker_offset = 2 * num_forwarders + 1
+
+updates_re = re.compile(r"Processing (\d+) updates took ([\d.e+-]+) seconds, ([\d.e+-]+) per second")
+flush_re = re.compile(r"Final flush took ([\d.e+-]+) seconds")
+
+
+def rank_role(rank):
+  if rank == 0:
+    return "leader"
+  if rank <= num_forwarders:
+    return "batch_forwarder"
+  if rank < distrib_worker_offset:
+    return "delta_forwarder"
+  return "worker"
+
+
+def wrap(cpu_dir, command):
+  """Run command as one MPI rank and record the CPU time it used."""
+  rank = os.environ.get("OMPI_COMM_WORLD_RANK", os.environ.get("PMI_RANK"))
+  if rank is None:
+    sys.exit("Could not determine the MPI rank of this process")
+  proc = subprocess.Popen(command)
+  _, status, usage = os.wait4(proc.pid, 0)
+  with open(os.path.join(cpu_dir, "cpu." + rank), "w") as cpu_file:
+    json.dump({"rank": int(rank), "user_sec": usage.ru_utime, "sys_sec": usage.ru_stime,
+               "max_rss_kb": usage.ru_maxrss}, cpu_file)
+  sys.exit(os.waitstatus_to_exitcode(status))
+
+
+def build(source_dir, build_root, num_batches):
+  build_dir = os.path.join(build_root, "build_nb%d" % num_batches)
+  subprocess.run(["cmake", "-S", source_dir, "-B", build_dir, "-DCMAKE_BUILD_TYPE=Release",
+                  "-DLANDSCAPE_NUM_BATCHES=%d" % num_batches], check=True)
+  subprocess.run(["cmake", "--build", build_dir, "--target", "speed_expr",
+                  "-j%d" % os.cpu_count()], check=True)
+  return os.path.join(build_dir, "speed_expr")
+
+
+def run_once(args, speed_expr, workers, inserters, run_dir):
+  cpu_dir = os.path.join(run_dir, "cpu")
+  os.makedirs(cpu_dir, exist_ok=True)
+  for name in os.listdir(cpu_dir):
+    os.remove(os.path.join(cpu_dir, name))
+
+  procs = distrib_worker_offset + workers
+  command = (["mpirun", "-np", str(procs)] + args.mpirun_args.split() +
+             [sys.executable, os.path.abspath(__file__), "--wrap", cpu_dir, "--",
+              speed_expr, str(inserters), "erdos", str(args.vertices), str(args.edges),
+              os.path.join(run_dir, "speed_expr_out.txt"), str(args.seed)])
+  start = time.time()
+  result = subprocess.run(command, cwd=run_dir, capture_output=True, text=True,
+                          timeout=args.timeout)
+  wall = time.time() - start
+  with open(os.path.join(run_dir, "stdout.txt"), "w") as log:
+    log.write(result.stdout)
+    log.write(result.stderr)
+  if result.returncode != 0:
+    raise RuntimeError("mpirun exited with %d, see %s" % (result.returncode, run_dir))
+
+  updates = updates_re.search(result.stdout)
+  flush = flush_re.search(result.stdout)
+  if updates is None or flush is None:
+    raise RuntimeError("Could not parse the output of speed_expr, see %s" % run_dir)
+
+  ranks = []
+  for name in os.listdir(cpu_dir):
+    with open(os.path.join(cpu_dir, name)) as cpu_file:
+      ranks.append(json.load(cpu_file))
+  ranks.sort(key=lambda r: r["rank"])
+  for rank in ranks:
+    rank["role"] = rank_role(rank["rank"])
+    rank["cpu_sec"] = rank["user_sec"] + rank["sys_sec"]
+
+  return {
+    "updates": int(updates.group(1)),
+    "ingest_sec": float(updates.group(2)),
+    "updates_per_sec": float(updates.group(3)),
+    "flush_sec": float(flush.group(1)),
+    "wall_sec": wall,
+    "ranks": ranks,
+  }
+
+
+def summarize_cpu(ranks):
+  cpu = {}
+  for role in ["leader", "batch_forwarder", "delta_forwarder", "worker"]:
+    role_cpu = [r["cpu_sec"] for r in ranks if r["role"] == role]
+    cpu[role + "_cpu_sec"] = sum(role_cpu)
+    cpu[role + "_max_cpu_sec"] = max(role_cpu) if role_cpu else 0
+  return cpu
+
+
+if __name__ == "__main__":
+  if len(sys.argv) > 1 and sys.argv[1] == "--wrap":
+    if len(sys.argv) < 5 or sys.argv[3] != "--":
+      sys.exit("usage: --wrap <cpu_dir> -- <command>")
+    wrap(sys.argv[2], sys.argv[4:])
+
+  parser = argparse.ArgumentParser(description="Single machine scaling benchmark of Landscape")
+  parser.add_argument("--workers", type=int, nargs="+", default=[1, 2, 4])
+  parser.add_argument("--inserters", type=int, nargs="+", default=[1, 4])
+  parser.add_argument("--num_batches", type=int, nargs="+", default=[32])
+  parser.add_argument("--vertices", type=int, default=1 << 13)
+  parser.add_argument("--edges", type=int, default=10000000)
+  parser.add_argument("--seed", type=int, default=437650290)
+  parser.add_argument("--repeats", type=int, default=3, help="runs of each configuration")
+  parser.add_argument("--source_dir", type=str,
+                      default=os.path.dirname(os.path.dirname(os.path.abspath(__file__))))
+  parser.add_argument("--work_dir", type=str, default="loopback_benchmark",
+                      help="where the builds, logs and results are placed")
+  parser.add_argument("--speed_expr", type=str, default="",
+                      help="use this speed_expr instead of building one for each num_batches")
+  parser.add_argument("--mpirun_args", type=str, default="--oversubscribe --bind-to none")
+  parser.add_argument("--timeout", type=int, default=3600, help="seconds allowed per run")
+  args = parser.parse_args()
+
+  if args.speed_expr and len(args.num_batches) > 1:
+    sys.exit("--speed_expr is built for a single num_batches")
+
+  work_dir = os.path.abspath(args.work_dir)
+  os.makedirs(work_dir, exist_ok=True)
+  csv_path = os.path.join(work_dir, "results.csv")
+  json_path = os.path.join(work_dir, "results.json")
+
+  fields = ["num_batches", "workers", "inserters", "repeat", "updates", "updates_per_sec",
+            "ingest_sec", "flush_sec", "wall_sec"]
+  cpu_fields = []
+  for role in ["leader", "batch_forwarder", "delta_forwarder", "worker"]:
+    cpu_fields += [role + "_cpu_sec", role + "_max_cpu_sec"]
+
+  results = []
+  with open(csv_path, "w", newline="") as csv_file:
+    writer = csv.DictWriter(csv_file, fieldnames=fields + cpu_fields)
+    writer.writeheader()
+    for num_batches in args.num_batches:
+      if args.speed_expr:
+        speed_expr = os.path.abspath(args.speed_expr)
+      else:
+        speed_expr = build(args.source_dir, work_dir, num_batches)
+
+      for workers in args.workers:
+        for inserters in args.inserters:
+          for repeat in range(args.repeats):
+            run_dir = os.path.join(work_dir, "runs",
+                                   "nb%d_w%d_i%d_r%d" % (num_batches, workers, inserters, repeat))
+            os.makedirs(run_dir, exist_ok=True)
+            print("num_batches=%d workers=%d inserters=%d repeat=%d" %
+                  (num_batches, workers, inserters, repeat), flush=True)
+            run = run_once(args, speed_expr, workers, inserters, run_dir)
+            run.update({"num_batches": num_batches, "workers": workers,
+                        "inserters": inserters, "repeat": repeat})
+            results.append(run)
+
+            row = {field: run[field] for field in fields}
+            row.update(summarize_cpu(run["ranks"]))
+            writer.writerow(row)
+            csv_file.flush()
+            print("  %.0f updates/sec, final flush %.3f sec" %
+                  (run["updates_per_sec"], run["flush_sec"]), flush=True)
+
+  with open(json_path, "w") as json_file:
+    json.dump({"vertices": args.vertices, "edges": args.edges, "seed": args.seed,
+               "runs": results}, json_file, indent=2)
+  print("Results written to %s and %s" % (csv_path, json_path))
@@ -0,0 +1,245 @@
+#include <mpi.h>
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <string>
+#include <tuple>
+#include <unordered_map>
+#include <vector>
+
+/*
+ * A PMPI interposition library that counts the messages, bytes and time spent
+ * in the MPI calls Landscape makes, per MessageCode tag and per peer rank.
+ * Link it ahead of MPI (cmake -DLANDSCAPE_PMPI=ON links it into speed_expr,
+ * query_expr and distrib_tests) or load it with LD_PRELOAD. At MPI_Finalize
+ * every rank's counts are gathered to rank 0, which prints a summary per tag
+ * and writes the full matrix to landscape_pmpi.csv, or the path given by the
+ * LANDSCAPE_PMPI_FILE environment variable.
+ */
+
+namespace {
+
+enum Call { SEND, SSEND, ISEND, PROBE, RECV, WAITANY, WAITALL, NUM_CALLS };
+const char *call_names[NUM_CALLS] = {"MPI_Send", "MPI_Ssend", "MPI_Isend", "MPI_Probe",
+                                     "MPI_Recv", "MPI_Waitany", "MPI_Waitall"};
+
+// the MessageCodes of worker_cluster.h, the tag is printed for any other value
+const char *tag_name(int tag) {
+  static const char *names[] = {"INIT", "BATCH", "DELTA", "QUERY", "FLUSH",
+                                "STOP", "SHUTDOWN", "TELEMETRY"};
+  if (tag >= 0 && tag < (int) (sizeof(names) / sizeof(names[0]))) return names[tag];
+  return nullptr;
+}
+
+struct Counts {
+  uint64_t calls = 0;
+  uint64_t bytes = 0;
+  uint64_t ns = 0;
+};
+
+// one row of the matrix as it is gathered to rank 0
+struct Row {
+  int call;
+  int rank;
+  int peer;
+  int tag;
+  uint64_t calls;
+  uint64_t bytes;
+  uint64_t ns;
+};
+
+struct Pending { // an MPI_Isend that has not completed
+  int peer;
+  int tag;
+  uint64_t bytes;
+};
+
+std::mutex counts_lock;
+std::map<std::tuple<int, int, int>, Counts> counts; // (call, peer, tag) -> counts
+std::unordered_map<MPI_Request, Pending> pending;
+
+uint64_t now_ns() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+      std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+uint64_t message_bytes(int count, MPI_Datatype datatype) {
+  int type_size;
+  PMPI_Type_size(datatype, &type_size);
+  return (uint64_t) count * type_size;
+}
+
+void add(Call call, int peer, int tag, uint64_t bytes, uint64_t ns) {
+  std::lock_guard<std::mutex> lk(counts_lock);
+  Counts &c = counts[std::make_tuple((int) call, peer, tag)];
+  c.calls++;
+  c.bytes += bytes;
+  c.ns += ns;
+}
+
+// attribute the completion of an MPI_Isend to its peer and tag. MPI implementations may
+// return the same handle for sends that completed immediately, those are counted as peer -1
+void complete(Call call, MPI_Request request, uint64_t ns) {
+  Pending info{-1, -1, 0};
+  {
+    std::lock_guard<std::mutex> lk(counts_lock);
+    auto it = pending.find(request);
+    if (it != pending.end()) {
+      info = it->second;
+      pending.erase(it);
+    }
+  }
+  add(call, info.peer, info.tag, info.bytes, ns);
+}
+
+void dump() {
+  int rank, num_ranks;
+  PMPI_Comm_rank(MPI_COMM_WORLD, &rank);
+  PMPI_Comm_size(MPI_COMM_WORLD, &num_ranks);
+
+  std::vector<Row> rows;
+  {
+    std::lock_guard<std::mutex> lk(counts_lock);
+    for (auto &entry : counts) {
+      rows.push_back({std::get<0>(entry.first), rank, std::get<1>(entry.first),
+                      std::get<2>(entry.first), entry.second.calls, entry.second.bytes,
+                      entry.second.ns});
+    }
+  }
+
+  int bytes = rows.size() * sizeof(Row);
+  std::vector<int> sizes(num_ranks);
+  PMPI_Gather(&bytes, 1, MPI_INT, sizes.data(), 1, MPI_INT, 0, MPI_COMM_WORLD);
+  std::vector<int> displs(num_ranks, 0);
+  std::vector<Row> all_rows;
+  if (rank == 0) {
+    for (int r = 1; r < num_ranks; r++) displs[r] = displs[r - 1] + sizes[r - 1];
+    all_rows.resize((displs[num_ranks - 1] + sizes[num_ranks - 1]) / sizeof(Row));
+  }
+  PMPI_Gatherv(rows.data(), bytes, MPI_CHAR, all_rows.data(), sizes.data(), displs.data(),
+               MPI_CHAR, 0, MPI_COMM_WORLD);
+  if (rank != 0) return;
+
+  const char *env_file = std::getenv("LANDSCAPE_PMPI_FILE");
+  std::string file = env_file != nullptr ? env_file : "landscape_pmpi.csv";
+  std::ofstream out{file, std::ios::trunc};
+  if (!out.is_open()) {
+    std::cerr << "landscape_pmpi: could not open " << file << std::endl;
+  } else {
+    out << "call,rank,peer,tag,tag_name,calls,bytes,seconds" << std::endl;
+    for (auto &row : all_rows) {
+      const char *name = tag_name(row.tag);
+      out << call_names[row.call] << "," << row.rank << "," << row.peer << "," << row.tag << ","
+          << (name == nullptr ? "" : name) << "," << row.calls << "," << row.bytes << ","
+          << row.ns / 1e9 << std::endl;
+    }
+  }
+
+  // summarize the messages sent per tag, summed over every pair of ranks
+  std::map<int, Counts> sent;
+  for (auto &row : all_rows) {
+    if (row.call != SEND && row.call != SSEND && row.call != ISEND) continue;
+    Counts &c = sent[row.tag];
+    c.calls += row.calls;
+    c.bytes += row.bytes;
+    c.ns += row.ns;
+  }
+  printf("===== MPI messages sent per tag (landscape_pmpi) =====\n");
+  printf("%-10s %14s %16s %12s\n", "tag", "messages", "MB", "send sec");
+  for (auto &entry : sent) {
+    const char *name = tag_name(entry.first);
+    std::string label = name == nullptr ? std::to_string(entry.first) : name;
+    printf("%-10s %14lu %16.2f %12.3f\n", label.c_str(), (unsigned long) entry.second.calls,
+           entry.second.bytes / 1e6, entry.second.ns / 1e9);
+  }
+  printf("Full matrix written to %s\n", file.c_str());
+  fflush(stdout);
+}
+
+}  // namespace
+
+extern "C" {
+
+int MPI_Send(const void *buf, int count, MPI_Datatype datatype, int dest, int tag,
+             MPI_Comm comm) {
+  uint64_t start = now_ns();
+  int ret = PMPI_Send(buf, count, datatype, dest, tag, comm);
+  add(SEND, dest, tag, message_bytes(count, datatype), now_ns() - start);
+  return ret;
+}
+
+int MPI_Ssend(const void *buf, int count, MPI_Datatype datatype, int dest, int tag,
+              MPI_Comm comm) {
+  uint64_t start = now_ns();
+  int ret = PMPI_Ssend(buf, count, datatype, dest, tag, comm);
+  add(SSEND, dest, tag, message_bytes(count, datatype), now_ns() - start);
+  return ret;
+}
+
+int MPI_Isend(const void *buf, int count, MPI_Datatype datatype, int dest, int tag,
+              MPI_Comm comm, MPI_Request *request) {
+  uint64_t start = now_ns();
+  int ret = PMPI_Isend(buf, count, datatype, dest, tag, comm, request);
+  uint64_t bytes = message_bytes(count, datatype);
+  add(ISEND, dest, tag, bytes, now_ns() - start);
+  std::lock_guard<std::mutex> lk(counts_lock);
+  pending[*request] = {dest, tag, bytes};
+  return ret;
+}
+
+int MPI_Probe(int source, int tag, MPI_Comm comm, MPI_Status *status) {
+  MPI_Status local_status;
+  if (status == MPI_STATUS_IGNORE) status = &local_status;
+  uint64_t start = now_ns();
+  int ret = PMPI_Probe(source, tag, comm, status);
+  int count;
+  PMPI_Get_count(status, MPI_CHAR, &count);
+  add(PROBE, status->MPI_SOURCE, status->MPI_TAG, count, now_ns() - start);
+  return ret;
+}
+
+int MPI_Recv(void *buf, int count, MPI_Datatype datatype, int source, int tag, MPI_Comm comm,
+             MPI_Status *status) {
+  MPI_Status local_status;
+  if (status == MPI_STATUS_IGNORE) status = &local_status;
+  uint64_t start = now_ns();
+  int ret = PMPI_Recv(buf, count, datatype, source, tag, comm, status);
+  int recv_count;
+  PMPI_Get_count(status, datatype, &recv_count);
+  add(RECV, status->MPI_SOURCE, status->MPI_TAG, message_bytes(recv_count, datatype),
+      now_ns() - start);
+  return ret;
+}
+
+int MPI_Waitany(int count, MPI_Request array_of_requests[], int *indx, MPI_Status *status) {
+  // completed requests are set to MPI_REQUEST_NULL so remember the handles
+  std::vector<MPI_Request> requests(array_of_requests, array_of_requests + count);
+  uint64_t start = now_ns();
+  int ret = PMPI_Waitany(count, array_of_requests, indx, status);
+  if (*indx != MPI_UNDEFINED) complete(WAITANY, requests[*indx], now_ns() - start);
+  return ret;
+}
+
+int MPI_Waitall(int count, MPI_Request array_of_requests[], MPI_Status array_of_statuses[]) {
+  std::vector<MPI_Request> requests(array_of_requests, array_of_requests + count);
+  uint64_t start = now_ns();
+  int ret = PMPI_Waitall(count, array_of_requests, array_of_statuses);
+  uint64_t ns = now_ns() - start;
+  for (MPI_Request request : requests) {
+    if (request != MPI_REQUEST_NULL) complete(WAITALL, request, ns / count);
+  }
+  return ret;
+}
+
+int MPI_Finalize() {
+  dump();
+  return PMPI_Finalize();
+}
+
+}  // extern "C"